@@ -0,0 +1,53 @@
+@ECHO OFF
+
+REM Builds the firmware with execution time profiling (PROFILE) and with the Wheelwriter
+REM BUS handshake done by the firmware itself (BUS_STUB, see hal.h), then runs it in the
+REM ucsim 8051 simulator that comes with SDCC. bench.txt is fed to serial 0, and stub.c plays the words of the
+REM Function Board on serial 1 and a few keys on the PS/2 lines. bench.txt ends with EOT,
+REM after which the firmware prints the timings at the end of bench.out and stops the
+REM simulator through its simulator interface (-I).
+REM
+REM ucsim has no model of the DS89C440; the DS390 is the nearest of its types, a Dallas
+REM core with the second serial port that the BUS is on. Its core takes 4 clocks per
+REM machine cycle where the DS89C440 takes 1, so the times are those of the DS390 and are
+REM for comparing one build against another. The table gives the count, average and worst
+REM case of each hot path in microseconds and in clocks, the latency of the timer 0
+REM interrupt, and the wake-up from idle mode in two parts (see prof.h). bench.base is the
+REM output of the last accepted build; the run ends by comparing the new output against it.
+
+REM compile...
+sdcc -c -DPROFILE -DBUS_STUB main.c
+sdcc -c -DPROFILE -DBUS_STUB config.c
+sdcc -c -DPROFILE -DBUS_STUB flash.c
+sdcc -c -DPROFILE -DBUS_STUB forms.c
+sdcc -c -DPROFILE -DBUS_STUB keyboard.c
+sdcc -c -DPROFILE -DBUS_STUB lpt1284.c
+sdcc -c -DPROFILE -DBUS_STUB prof.c
+sdcc -c -DPROFILE -DBUS_STUB sched.c
+sdcc -c -DPROFILE -DBUS_STUB spool.c
+sdcc -c -DPROFILE -DBUS_STUB stats.c
+sdcc -c -DPROFILE -DBUS_STUB stub.c
+sdcc -c -DPROFILE -DBUS_STUB trace.c
+sdcc -c -DPROFILE -DBUS_STUB tty.c
+sdcc -c -DPROFILE -DBUS_STUB uart12.c
+sdcc -c -DPROFILE -DBUS_STUB watchdog.c
+sdcc -c -DPROFILE -DBUS_STUB wheelwriter.c
+
+REM link...
+sdcc --code-size 0x3E00 --xram-size 0x02E0 -o bench.ihx main.rel config.rel flash.rel forms.rel keyboard.rel lpt1284.rel prof.rel sched.rel spool.rel stats.rel stub.rel trace.rel tty.rel uart12.rel watchdog.rel wheelwriter.rel
+
+REM run...
+(echo run& echo quit) | s51 -t DS390 -X 12M -I if=xram[0xffff] -S in=bench.txt,out=bench.out bench.ihx
+
+REM compare...
+if exist bench.base fc bench.base bench.out
+
+REM optional cleanup...
+del *.asm
+del *.lk
+del *.lst
+del *.map
+del *.mem
+del *.rel
+del *.rst
+del *.sym
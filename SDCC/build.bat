@@ -2,13 +2,32 @@
 
 REM compile...
 sdcc -c main.c
+sdcc -c config.c
+sdcc -c flash.c
+sdcc -c forms.c
+sdcc -c sched.c
+sdcc -c spool.c
+sdcc -c stats.c
 sdcc -c keyboard.c
+sdcc -c lpt1284.c
+sdcc -c trace.c
+sdcc -c tty.c
 sdcc -c uart12.c
 sdcc -c watchdog.c
 sdcc -c wheelwriter.c
 
-REM link...
-sdcc main.c keyboard.rel uart12.rel watchdog.rel wheelwriter.rel
+REM link, keeping the code below the configuration page (see config.h; the job spool and the form
+REM templates are in the upper 16K, see spool.h and forms.h) and xdata below the buffers that survive
+REM a reset (see journal.h)...
+sdcc --code-size 0x3E00 --xram-size 0x02E0 main.c config.rel flash.rel forms.rel keyboard.rel lpt1284.rel sched.rel spool.rel stats.rel trace.rel tty.rel uart12.rel watchdog.rel wheelwriter.rel
+
+REM check the size: the linker only warns when the code runs into the configuration page...
+type main.mem
+findstr /C:"Insufficient" main.mem > nul
+if not errorlevel 1 (
+    echo The code does not fit below 0x3E00, printer.hex was not made.
+    exit /b 1
+)
 
 REM make Intel HEX file...
 packihx main.ihx > printer.hex
@@ -0,0 +1,146 @@
+//  Configuration saved in flash
+//  for the Small Device C Compiler (SDCC)
+//
+//  The settings are kept in 'cfg' and saved to a reserved page of the flash by in-application
+//  programming. A save goes into the next unused slot of the page, so the page is only erased
+//  once every CFG_SLOTS saves, and saving settings that haven't changed writes nothing. At
+//  start up the newest slot with a good CRC is loaded; if there is none, the defaults are used.
+//  The printwheel found at start up is cached on its own (cfg_save_wheel()), so that caching it
+//  doesn't save settings that were changed but never saved.
+
+#include <stddef.h>
+#include "hal.h"
+#include "config.h"
+
+#define FALSE 0
+#define TRUE  1
+
+__xdata cfg_t cfg;                                          // the settings in use
+static __xdata cfg_t rec;                                   // a record read from the flash by cfg_load() or cfg_save()
+
+//-----------------------------------------------------------
+// CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF) of
+// the record, not counting the crc itself
+//-----------------------------------------------------------
+static unsigned short cfg_crc(__xdata unsigned char *p) {
+    unsigned short crc = 0xFFFF;
+    unsigned char i,bit;
+
+    for (i=0; i<offsetof(cfg_t,crc); i++) {
+        crc ^= (unsigned int)p[i] << 8;
+        for (bit=0; bit<8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+//-----------------------------------------------------------
+// copy slot 'n' of the flash page into 'rec'
+//-----------------------------------------------------------
+static void cfg_read_slot(unsigned char n, __xdata cfg_t *rec) {
+    unsigned char i;
+
+    for (i=0; i<CFG_SLOTSIZE; i++)
+        ((__xdata unsigned char *)rec)[i] = HAL_FLASH_READ(CFG_BASE+(n*CFG_SLOTSIZE)+i);
+}
+
+//-----------------------------------------------------------
+// load the default settings
+//-----------------------------------------------------------
+void cfg_defaults(void) {
+    unsigned char i;
+
+    cfg.magic = CFG_MAGIC;
+    cfg.uSpacesPerChar = 10;                                // 12 characters per inch
+    cfg.uLinesPerLine = 16;                                 // 6 lines per inch
+    cfg.tabStop = 6;                                        // tab stops every 1/2 inch
+    cfg.options = CFG_LF_SWITCH;
+    cfg.baud = BAUD_9600;
+    cfg.printWheel = 0;                                     // unknown
+    cfg.lastWheel = 0;
+    for (i=0; i<sizeof(cfg.reserved); i++)
+        cfg.reserved[i] = 0xFF;
+}
+
+//-----------------------------------------------------------
+// load the newest valid record from flash. returns TRUE if
+// one was found, FALSE if the defaults are being used.
+//-----------------------------------------------------------
+__bit cfg_load(void) {
+    unsigned char n,i;
+    __bit found = FALSE;
+
+    cfg_defaults();
+    for (n=0; n<CFG_SLOTS; n++) {
+        cfg_read_slot(n,&rec);
+        if (rec.magic == 0xFF)                              // unused slot, the ones after it are unused too
+            break;
+        if ((rec.magic == CFG_MAGIC) && (rec.crc == cfg_crc((__xdata unsigned char *)&rec))) {
+            for (i=0; i<CFG_SLOTSIZE; i++)                  // the newest good one so far
+                ((__xdata unsigned char *)&cfg)[i] = ((__xdata unsigned char *)&rec)[i];
+            found = TRUE;
+        }
+    }
+    return found;
+}
+
+//-----------------------------------------------------------
+// save the settings in the next unused slot, erasing the page
+// first if there are none left. returns FALSE if the flash did
+// not read back correctly.
+//-----------------------------------------------------------
+__bit cfg_save(void) {
+    unsigned char n,i,last;
+    unsigned int addr;
+
+    cfg.magic = CFG_MAGIC;
+    cfg.crc = cfg_crc((__xdata unsigned char *)&cfg);
+
+    last = 0xFF;                                            // newest used slot
+    for (n=0; n<CFG_SLOTS; n++) {
+        if (HAL_FLASH_READ(CFG_BASE+(n*CFG_SLOTSIZE)) == 0xFF)
+            break;
+        last = n;
+    }
+    if (last != 0xFF) {                                     // nothing to do if the newest record is the same
+        cfg_read_slot(last,&rec);
+        for (i=0; i<CFG_SLOTSIZE; i++)
+            if (((__xdata unsigned char *)&rec)[i] != ((__xdata unsigned char *)&cfg)[i])
+                break;
+        if (i == CFG_SLOTSIZE)
+            return TRUE;
+    }
+    if (n == CFG_SLOTS) {                                   // page full, start over
+        HAL_FLASH_CMD(FLASH_ERASE,CFG_BASE,0xFF);
+        n = 0;
+    }
+
+    addr = CFG_BASE+(n*CFG_SLOTSIZE);
+    for (i=0; i<CFG_SLOTSIZE; i++) {                        // the magic byte goes first; a save cut short leaves a bad CRC
+        HAL_FLASH_CMD(FLASH_PROGRAM,addr+i,((__xdata unsigned char *)&cfg)[i]);
+        if (HAL_FLASH_READ(addr+i) != ((__xdata unsigned char *)&cfg)[i])
+            return FALSE;
+    }
+    return TRUE;
+}
+
+//-----------------------------------------------------------
+// cache the printwheel reported at start up in flash: the
+// newest saved record (or the defaults) is saved again with
+// only 'lastWheel' changed. the settings in use are kept.
+//-----------------------------------------------------------
+__bit cfg_save_wheel(unsigned char wheel) {
+    static __xdata cfg_t live;
+    unsigned char i;
+    __bit ok;
+
+    for (i=0; i<CFG_SLOTSIZE; i++)
+        ((__xdata unsigned char *)&live)[i] = ((__xdata unsigned char *)&cfg)[i];
+    cfg_load();
+    cfg.lastWheel = wheel;
+    ok = cfg_save();
+    for (i=0; i<CFG_SLOTSIZE; i++)
+        ((__xdata unsigned char *)&cfg)[i] = ((__xdata unsigned char *)&live)[i];
+    cfg.lastWheel = wheel;
+    return ok;
+}
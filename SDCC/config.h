@@ -0,0 +1,60 @@
+//  Configuration saved in flash
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+// the 512 bytes at the top of the lower 16K of the DS89C440's 32K flash are reserved for the
+// configuration (the link in build.bat limits the code to the space below). the page is written
+// 16 bytes at a time, one slot after another, and only erased when all of its slots have been used.
+#define CFG_BASE     0x3E00
+#define CFG_PAGESIZE 512
+#define CFG_SLOTSIZE 16
+#define CFG_SLOTS    (CFG_PAGESIZE/CFG_SLOTSIZE)
+
+#define CFG_MAGIC    0x5A                                   // first byte of a saved record (0xFF is an unused slot)
+
+// options
+#define CFG_LF_SWITCH 0x00                                  // auto linefeed after carriage return as set by dip switch 1
+#define CFG_LF_ON     0x01                                  // auto linefeed on regardless of dip switch 1
+#define CFG_LF_OFF    0x02                                  // auto linefeed off regardless of dip switch 1
+#define CFG_LF_MASK   0x03
+#define CFG_DRAFT     0x04                                  // draft printing (also selected by dip switch 3)
+#define CFG_ORDER     0x08                                  // strike ordering for serial and parallel port jobs
+#define CFG_TTY_OFF    0x00                                 // terminal mode off (see tty.h)
+#define CFG_TTY_RAW    0x10                                 // terminal mode, a key at a time
+#define CFG_TTY_COOKED 0x20                                 // terminal mode, a line at a time
+#define CFG_TTY_MASK   0x30
+#define CFG_1284       0x40                                 // IEEE 1284 reverse channel on the parallel port (see lpt1284.h)
+#define CFG_KBHOST     0x80                                 // the PS/2 keyboard's keys go to the host (see tty.h)
+
+// serial 0 bit rates
+#define BAUD_2400     0
+#define BAUD_4800     1
+#define BAUD_9600     2
+#define BAUD_19200    3
+
+typedef struct {
+    unsigned char magic;                                    // CFG_MAGIC
+    unsigned char uSpacesPerChar;                           // pitch
+    unsigned char uLinesPerLine;
+    unsigned char tabStop;
+    unsigned char options;                                  // CFG_LF_xxx, CFG_DRAFT, CFG_ORDER, CFG_TTY_xxx, CFG_1284, CFG_KBHOST
+    unsigned char baud;                                     // BAUD_xxx
+    unsigned char printWheel;                               // printwheel installed when the settings were saved
+    unsigned char lastWheel;                                // printwheel reported at the last start up (see cfg_save_wheel())
+    unsigned char reserved[6];                              // 0xFF
+    unsigned short crc;                                     // CRC-16/CCITT of the bytes above
+} cfg_t;
+
+// a record is exactly one slot, crc included (the array size is -1, an error, if not)
+typedef char cfg_slot_check[(sizeof(cfg_t) == CFG_SLOTSIZE) ? 1 : -1];
+
+extern __xdata cfg_t cfg;
+
+__bit cfg_load(void);
+__bit cfg_save(void);
+__bit cfg_save_wheel(unsigned char wheel);
+void cfg_defaults(void);
+
+#endif
@@ -0,0 +1,87 @@
+//  Flash writes between bus exchanges
+//  for the Small Device C Compiler (SDCC)
+//
+//  The interrupts are held off while the flash is erased or programmed (see HAL_FLASH_CMD),
+//  and a page erase takes milliseconds: long enough to lose the words on the Wheelwriter BUS,
+//  which can come every 59 microseconds, and the bits from the PS/2 keyboard. So the bytes for
+//  the flash are collected in RAM and programmed a batch at a time, and each erase or batch is
+//  done in a quiet moment (see flash_hold()). The job spool and the form templates are written
+//  this way; flash_flush() is called when the main loop has nothing to do, and by anything that
+//  is about to read back what it wrote.
+//
+//  Only one run of consecutive addresses is collected. A byte that doesn't follow it, or that
+//  finds the batch full, has the batch programmed first.
+
+#include "hal.h"
+#include "uart12.h"
+#include "keyboard.h"
+#include "flash.h"
+
+// passes of the loop in flash_hold() that the BUS must stay high for: a few hundred microseconds,
+// longer than the gap between a word and its acknowledge or between the words of a command
+#define FLASH_QUIET 200
+
+__xdata unsigned char flashBuf[FLASH_BATCH];                // bytes waiting to be programmed
+__xdata unsigned int flashAddr;                             // where flashBuf[0] goes
+unsigned char flashCount = 0;                               // bytes in flashBuf
+
+//-----------------------------------------------------------
+// wait for a quiet moment before a flash command: serial 0 is
+// paused, the keyboard is held off (it sends what it has once
+// it's let go), and the BUS has been idle long enough that no
+// exchange is under way. the Printer Board only speaks when
+// it's spoken to, but a key pressed on the Wheelwriter at just
+// the wrong moment can still lose a word from the Function
+// Board, which can't be held off.
+//-----------------------------------------------------------
+static void flash_hold(void) {
+    unsigned int n;
+
+    uart_hold();                                            // characters arriving while the flash is busy would be lost
+    kb_hold();
+    for (n=0; n<FLASH_QUIET; n++)
+        if (!WWbus)                                         // a word or an acknowledge, start again
+            n = 0;
+}
+
+static void flash_release(void) {
+    kb_release();
+    uart_release();
+}
+
+//-----------------------------------------------------------
+// program the bytes collected
+//-----------------------------------------------------------
+void flash_flush(void) {
+    unsigned char i;
+
+    if (!flashCount)
+        return;
+    flash_hold();
+    for (i=0; i<flashCount; i++)
+        HAL_FLASH_CMD(FLASH_PROGRAM,flashAddr+i,flashBuf[i]);
+    flash_release();
+    flashCount = 0;
+}
+
+//-----------------------------------------------------------
+// erase the page holding 'addr' (the bytes collected so far
+// are programmed first, they may be in it)
+//-----------------------------------------------------------
+void flash_erase(unsigned int addr) {
+    flash_flush();
+    flash_hold();
+    HAL_FLASH_CMD(FLASH_ERASE,addr,0xFF);
+    flash_release();
+}
+
+//-----------------------------------------------------------
+// collect a byte to be programmed at 'addr'
+//-----------------------------------------------------------
+void flash_put(unsigned int addr,unsigned char c) {
+    if (flashCount && ((flashCount == FLASH_BATCH) || (addr != flashAddr+flashCount)))
+        flash_flush();
+    if (!flashCount)
+        flashAddr = addr;
+    flashBuf[flashCount++] = c;
+}
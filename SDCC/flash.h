@@ -0,0 +1,13 @@
+//  Flash writes between bus exchanges
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+#define FLASH_BATCH 16                                      // bytes collected before they're programmed (xdata is nearly full)
+
+void flash_erase(unsigned int addr);
+void flash_put(unsigned int addr,unsigned char c);
+void flash_flush(void);
+
+#endif
@@ -0,0 +1,372 @@
+//  Form templates in flash
+//  for the Small Device C Compiler (SDCC)
+//
+//  A form is fixed text and numbered fields, each at a micro space (1/120 inch) and micro line
+//  (1/96 inch) from the top left corner of the form. The host defines the form once with
+//  <ESC><F><n>, which keeps it in flash, and from then on sends only <ESC><f><n> and the values
+//  of the fields. The items aren't printed in the order they were defined: the paper only moves
+//  up, one line of items at a time, and along each line the carrier starts from the end nearer
+//  to it and goes straight from one item to the next (see form_next()).
+//
+//  Each item is a record in the template page: the form number, the line and the position
+//  (high byte first), the field number (0 for text), then the text and a zero. Defining a form
+//  again programs the form number of its old records to zero so they're skipped; the page is
+//  only erased by <ESC><F><0>. The template page is written through flash.c, which keeps the
+//  flash commands off the buses (see flash_hold()). The values of the form being filled in go in RAM, in the buffer
+//  of the correction memory (which forgets what it had, see ww_lend_memory()) until the form has
+//  been printed, one after another, each ending with a zero. They may take CMSIZE-1 bytes in all.
+
+#include <stdio.h>
+#include "hal.h"
+#include "flash.h"
+#include "wheelwriter.h"
+#include "forms.h"
+
+#define FALSE 0
+#define TRUE  1
+#define EOT   0x04
+#define LF    0x0A
+#define CR    0x0D
+
+#define FORM_END   (FORM_BASE+FORM_PAGESIZE)
+#define VALUES_END (CMSIZE-1)                              // the last byte stays zero, the end of a missing value
+
+// what form_define_put() and form_fill_put() expect next
+#define FS_ID    0                                          // the form number
+#define FS_LINE  1                                          // the item's line
+#define FS_POS   2                                          // the item's position
+#define FS_TEXT  3                                          // the text of an item, or a field value
+#define FS_FIELD 4                                          // the field number of an item
+#define FS_SKIP  5                                          // the rest of the line
+
+extern unsigned char column;                                // defined in main.c
+extern unsigned char uSpacesPerChar;                        // defined in wheelwriter.c
+extern unsigned int  uLineCount;                            // defined in wheelwriter.c
+extern unsigned int  uSpaceCount;                           // defined in wheelwriter.c
+
+__bit form_printing = FALSE;                                // form_get() has the form to print
+__bit formOpen;                                             // an item has been started in the template page, it needs its zero
+__bit formEmpty;                                            // nothing yet on the line of the definition
+__bit formFull;                                             // the template page filled up during the definition
+__bit formStarted;                                          // an item has been printed, formLine, formPos and formItem are valid
+__bit formRight;                                            // the items on formLine are being printed left to right
+__bit formReading;                                          // formChar is valid
+__bit formInValue;                                          // formChar is in formValues, not the template page
+unsigned char formState;
+unsigned char formId;                                       // the form being defined, filled in or printed
+unsigned char formFields;                                   // highest field number of the form being filled in
+unsigned char formField;                                    // values received so far
+__xdata unsigned int formWrite;                             // where the next byte goes in the flash, or in formValues
+__xdata unsigned int formNumber;                            // the number being received
+__xdata unsigned int formLineIn;                            // the line of the item being defined
+__xdata unsigned int formOrigin;                            // uLineCount at the top of the form
+__xdata unsigned int formLine;                              // line, position and address of the item being printed
+__xdata unsigned int formPos;
+__xdata unsigned int formItem;
+__xdata unsigned int formChar;                              // next character of the item being printed
+__xdata unsigned char *formValues;                          // the field values (see ww_lend_memory())
+
+// the two bytes at 'addr', high byte first
+static unsigned int form_word(unsigned int addr) {
+    return ((unsigned int)HAL_FLASH_READ(addr) << 8) | HAL_FLASH_READ(addr+1);
+}
+
+// the address of the record after the one at 'addr'
+static unsigned int form_skip(unsigned int addr) {
+    addr += FORM_HEADER;
+    while ((addr < FORM_END) && HAL_FLASH_READ(addr++))
+        ;
+    return addr;
+}
+
+// TRUE if the item at position 'p1' and address 'a1' comes after the one at 'p2' and 'a2', left to right
+static __bit form_after(unsigned int p1,unsigned int a1,unsigned int p2,unsigned int a2) {
+    return (p1 > p2) || ((p1 == p2) && (a1 > a2));
+}
+
+static unsigned int form_distance(unsigned int p1,unsigned int p2) {
+    return (p1 > p2) ? p1-p2 : p2-p1;
+}
+
+// start the next line of the definition
+static void form_line(void) {
+    formState = FS_LINE;
+    formNumber = 0;
+    formEmpty = TRUE;
+}
+
+// write the start of an item at formLineIn, formNumber if there's room for it and the zero that ends it
+static void form_header(unsigned char field) {
+    if (formWrite+FORM_HEADER >= FORM_END) {
+        formFull = TRUE;
+        return;
+    }
+    flash_put(formWrite++,formId);
+    flash_put(formWrite++,formLineIn >> 8);
+    flash_put(formWrite++,formLineIn & 0xFF);
+    flash_put(formWrite++,formNumber >> 8);
+    flash_put(formWrite++,formNumber & 0xFF);
+    flash_put(formWrite++,field);
+    formOpen = TRUE;
+}
+
+//-----------------------------------------------------------
+// <ESC><F> starts a definition. the characters that follow go
+// to form_define_put(), the first one being the form number.
+//-----------------------------------------------------------
+void form_define(void) {
+    formState = FS_ID;
+}
+
+//-----------------------------------------------------------
+// a character of the definition: the form number (1-9, or 0 to
+// erase all of the forms), then one item on each line:
+//   line,position:text   fixed text
+//   line,position=n      field n (1-9)
+// LF is ignored, lines that aren't items are skipped. returns
+// FALSE when an empty line or EOT has ended the definition.
+//-----------------------------------------------------------
+__bit form_define_put(unsigned char c) {
+    unsigned int a;
+
+    if (formState == FS_ID) {
+        if (c == '0') {                                     // erase all of the forms
+            flash_erase(FORM_BASE);
+            return FALSE;
+        }
+        if ((c < '1') || (c > '9'))                         // not a form number, ignore the sequence
+            return FALSE;
+        formId = c;
+        flash_flush();                                      // the page as it will be, before reading it
+        for (a=FORM_BASE; (a < FORM_END) && (HAL_FLASH_READ(a) != 0xFF); a=form_skip(a))
+            if (HAL_FLASH_READ(a) == formId)
+                flash_put(a,0x00);                          // the old definition is replaced
+        formWrite = a;
+        formOpen = FALSE;
+        formFull = FALSE;
+        form_line();
+        formEmpty = FALSE;                                  // (the line break after the form number doesn't end it)
+        return TRUE;
+    }
+    if (c == LF)
+        return TRUE;
+    if ((c == CR) || (c == EOT)) {
+        if (formOpen) {
+            flash_put(formWrite++,0x00);                    // the end of the item
+            formOpen = FALSE;
+        }
+        else if (formEmpty)                                 // an empty line ends the definition
+            c = EOT;
+        if (c == EOT) {
+            flash_flush();                                  // the form is ready to be filled in
+            if (formFull)
+                printf("\nForm memory full\n");
+            return FALSE;
+        }
+        form_line();
+        return TRUE;
+    }
+    formEmpty = FALSE;
+    switch (formState) {
+        case FS_LINE:
+        case FS_POS:
+            if ((c >= '0') && (c <= '9'))
+                formNumber = formNumber*10+(c-'0');
+            else if ((c == ',') && (formState == FS_LINE)) {
+                formLineIn = formNumber;
+                formNumber = 0;
+                formState = FS_POS;
+            }
+            else if ((c == ':') && (formState == FS_POS)) {
+                form_header(0);
+                formState = FS_TEXT;
+            }
+            else if ((c == '=') && (formState == FS_POS))
+                formState = FS_FIELD;
+            else
+                formState = FS_SKIP;                        // not an item, skip the line
+            break;
+        case FS_FIELD:
+            if ((c >= '1') && (c <= '9'))
+                form_header(c-'0');
+            formState = FS_SKIP;
+            break;
+        case FS_TEXT:
+            if (formOpen && (c > 0x1F) && (c < 0x7F) && (formWrite+1 < FORM_END))
+                flash_put(formWrite++,c);
+    }
+    return TRUE;
+}
+
+//-----------------------------------------------------------
+// <ESC><f> starts filling in a form. the characters that follow
+// go to form_fill_put(), the first one being the form number.
+//-----------------------------------------------------------
+void form_fill(void) {
+    formState = FS_ID;
+}
+
+//-----------------------------------------------------------
+// a character of the fill: the form number, then the value of
+// each field in turn (1, 2, 3...), each ending with CR. returns
+// FALSE when the form is ready to print (form_printing), after
+// the last value or EOT, or when there's no such form.
+//-----------------------------------------------------------
+__bit form_fill_put(unsigned char c) {
+    unsigned int a;
+    __bit found;
+
+    if (formState == FS_ID) {
+        if ((c < '1') || (c > '9'))                         // not a form number, ignore the sequence
+            return FALSE;
+        formId = c;
+        formFields = 0;
+        found = FALSE;
+        flash_flush();                                      // (a definition just sent may still be in RAM)
+        for (a=FORM_BASE; (a < FORM_END) && (HAL_FLASH_READ(a) != 0xFF); a=form_skip(a)) {
+            if (HAL_FLASH_READ(a) == formId) {
+                found = TRUE;
+                if (HAL_FLASH_READ(a+5) > formFields)
+                    formFields = HAL_FLASH_READ(a+5);
+            }
+        }
+        if (!found) {
+            printf("\nNo such form\n");
+            return FALSE;
+        }
+        formValues = ww_lend_memory();
+        formValues[VALUES_END] = 0x00;
+        formWrite = 0;
+        formField = 0;
+        formState = FS_TEXT;
+        if (formFields)
+            return TRUE;
+    }
+    else if ((c == CR) || (c == EOT)) {
+        if (formWrite < VALUES_END)
+            formValues[formWrite++] = 0x00;                 // the end of the value
+        if ((++formField < formFields) && (c != EOT))
+            return TRUE;
+    }
+    else {
+        if ((c > 0x1F) && (c < 0x7F) && (formWrite+1 < VALUES_END))
+            formValues[formWrite++] = c;
+        return TRUE;
+    }
+    for (; formField < formFields; formField++)             // the values not sent are empty
+        if (formWrite < VALUES_END)
+            formValues[formWrite++] = 0x00;
+    form_printing = TRUE;                                   // the values are in, print the form from here down
+    formStarted = FALSE;
+    formReading = FALSE;
+    formOrigin = uLineCount;
+    return FALSE;
+}
+
+// where the value of field 'n' starts in formValues
+static unsigned int form_value(unsigned char n) {
+    unsigned int a;
+
+    a = 0;
+    while (--n)
+        while ((a < VALUES_END) && formValues[a++])
+            ;
+    return a;
+}
+
+// the character at 'a' of the item being printed
+static unsigned char form_char(unsigned int a) {
+    return formInValue ? formValues[a] : HAL_FLASH_READ(a);
+}
+
+//-----------------------------------------------------------
+// choose the next item of the form to print: the next one along
+// the line in the direction it's being printed, or else the
+// nearer end of the next line down. sets formLine, formPos and
+// formItem. returns FALSE when every item has been printed.
+//-----------------------------------------------------------
+static __bit form_next(void) {
+    unsigned int a,pos,line,next,best,bestPos,last,lastPos;
+
+    best = bestPos = 0;
+    if (formStarted) {
+        for (a=FORM_BASE; (a < FORM_END) && (HAL_FLASH_READ(a) != 0xFF); a=form_skip(a)) {
+            if ((HAL_FLASH_READ(a) != formId) || (form_word(a+1) != formLine))
+                continue;
+            pos = form_word(a+3);
+            if (formRight ? (form_after(pos,a,formPos,formItem) && (!best || form_after(bestPos,best,pos,a)))
+                          : (form_after(formPos,formItem,pos,a) && (!best || form_after(pos,a,bestPos,best)))) {
+                best = a;
+                bestPos = pos;
+            }
+        }
+        if (best) {
+            formItem = best;
+            formPos = bestPos;
+            return TRUE;
+        }
+    }
+    last = lastPos = next = 0;
+    for (a=FORM_BASE; (a < FORM_END) && (HAL_FLASH_READ(a) != 0xFF); a=form_skip(a)) {
+        if (HAL_FLASH_READ(a) != formId)
+            continue;
+        line = form_word(a+1);
+        if (formStarted && (line <= formLine))
+            continue;
+        pos = form_word(a+3);
+        if (!best || (line < next)) {                       // the first item on a line further up
+            next = line;
+            best = last = a;
+            bestPos = lastPos = pos;
+        }
+        else if (line == next) {
+            if (form_after(bestPos,best,pos,a)) {
+                best = a;
+                bestPos = pos;
+            }
+            if (form_after(pos,a,lastPos,last)) {
+                last = a;
+                lastPos = pos;
+            }
+        }
+    }
+    if (!best)
+        return FALSE;
+    formStarted = TRUE;
+    formLine = next;
+    formRight = (form_distance(bestPos,uSpaceCount) <= form_distance(lastPos,uSpaceCount));
+    formItem = formRight ? best : last;
+    formPos = formRight ? bestPos : lastPos;
+    return TRUE;
+}
+
+//-----------------------------------------------------------
+// returns the next character of the form to print, with the
+// carrier and paper already moved to it, or 0 when the whole
+// form has been printed
+//-----------------------------------------------------------
+unsigned char form_get(void) {
+    unsigned char c,field;
+
+    while (TRUE) {
+        if (formReading) {
+            c = form_char(formChar++);
+            if (c && (c != 0xFF))
+                return c;
+        }
+        if (!form_next()) {
+            form_printing = FALSE;
+            ww_return_memory();                             // the values aren't needed any more
+            return 0;
+        }
+        field = HAL_FLASH_READ(formItem+5);
+        formInValue = (field != 0);
+        formChar = field ? form_value(field) : formItem+FORM_HEADER;
+        formReading = TRUE;
+        c = form_char(formChar);
+        if (c && (c != 0xFF)) {                             // (nothing to print, no need to go there)
+            ww_move_to(formPos,formOrigin+formLine);
+            column = formPos/uSpacesPerChar+1;
+        }
+    }
+}
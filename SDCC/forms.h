@@ -0,0 +1,22 @@
+//  Form templates in flash
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __FORMS_H__
+#define __FORMS_H__
+
+// the templates are kept in the flash page at FORM_BASE, above the job spool (see spool.h).
+// the field values of the form being filled in are kept in RAM, in the correction memory's
+// buffer (see ww_lend_memory()).
+#define FORM_BASE     0x4800
+#define FORM_PAGESIZE 512
+#define FORM_HEADER   6                                     // form, line, position and field ahead of the text
+
+extern __bit form_printing;
+
+void form_define(void);
+__bit form_define_put(unsigned char c);
+void form_fill(void);
+__bit form_fill_put(unsigned char c);
+unsigned char form_get(void);
+
+#endif
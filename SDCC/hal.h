@@ -0,0 +1,146 @@
+//  Hardware abstraction layer
+//  for the Small Device C Compiler (SDCC)
+//
+//  Pin assignments and the few hardware operations used by the Wheelwriter, UART, LPT and
+//  PS/2 code. Compiled by SDCC these are the DS89C440 SFRs and bits themselves. Compiled by
+//  any other compiler they come from hal_host.h (in the host folder), which simulates the
+//  board so that the same code can be run on an ordinary build machine.
+
+#ifndef __HAL_H__
+#define __HAL_H__
+
+#ifdef __SDCC
+
+#include "reg420.h"
+
+// dip switches
+__sbit __at (0x80) switch1;               // dip switch connected to pin 39 0=on, 1=off (auto LF after CR if on)
+__sbit __at (0x81) switch2;               // dip switch connected to pin 38 0=on, 1=off (not used)
+__sbit __at (0x82) switch3;               // dip switch connected to pin 37 0=on, 1=off (draft printing if on)
+__sbit __at (0x83) switch4;               // dip switch connected to pin 36 0=on, 1=off (not used)
+
+// LEDs
+__sbit __at (0x84) redLED;                // red   LED connected to pin 35 0=on, 1=off
+__sbit __at (0x85) amberLED;              // amber LED connected to pin 34 0=on, 1=off
+__sbit __at (0x86) greenLED;              // green LED connected to pin 33 0=on, 1=off
+
+// LPT port, data is read from port 2, strobe is INT0 (pin 12)
+__sbit __at (0x90) ackPin;                // Acknowledge output for LPT port on pin 1
+__sbit __at (0x91) busyPin;               // Busy output for LPT port on pin 2
+
+// IEEE 1284 lines on the spare pins, used only when the reverse channel is turned on (see lpt1284.c)
+__sbit __at (0xB2) strobePin;             // nStrobe, INT0 (pin 12), read during the negotiation
+__sbit __at (0xB4) selectInPin;           // nSelectIn (1284 Active) input on pin 14
+__sbit __at (0xB5) autoFdPin;             // nAutoFd (HostBusy) input on pin 15
+__sbit __at (0x97) pePin;                 // PError (AckDataReq) output on pin 8
+__sbit __at (0x87) selectPin;             // Select (Xflag) output on pin 32, needs a pull-up resistor
+__sbit __at (0x83) faultPin;              // nFault (nDataAvail) output on pin 36, shared with dip switch 4 (leave it off)
+
+// Wheelwriter BUS
+__sbit __at (0x92) WWbus;                 // P1.2, (RXD1, pin 3) used to monitor the Wheelwriter BUS
+
+// PS/2 keyboard
+__sbit __at (0x94) kb_clock_out;          // pin 5
+__sbit __at (0x95) kb_data_out;           // pin 6
+__sbit __at (0x96) kb_data_in;            // pin 7
+__sbit __at (0xB3) kb_clock_in;           // pin 13
+
+// serial 0 handshaking
+__sbit __at (0xB6) CTS;                   // pin 16
+__sbit __at (0xB7) RTS;                   // pin 17
+
+#define NOP() __asm NOP __endasm
+
+// spin until 'cond' becomes true
+#define HAL_WAIT(cond) while (!(cond))
+
+// load the serial 0 transmit buffer
+#define HAL_UART0_TX(c) SBUF0 = (c)
+
+#ifndef BUS_STUB
+
+// load the serial 1 transmit buffer with a 9 bit Wheelwriter word
+// (ninth bit in TB8_1, lower 8 bits in SBUF1)
+#define HAL_WW_TX(w) {                                                               \
+    TB8_1 = ((w) & 0x100);                                                           \
+    SBUF1 = (w) & 0xFF;                                                              \
+}
+
+// wait for the Printer Board's acknowledge: the bus goes high, low, then high again
+#define HAL_WW_WAIT_ACK() {                                                          \
+    HAL_WAIT(WWbus);                                                                 \
+    HAL_WAIT(!WWbus);                                                                \
+    HAL_WAIT(WWbus);                                                                 \
+}
+
+// read the word received on serial 1
+#define HAL_WW_RX(lo,ninth) {                                                        \
+    lo = SBUF1;                                                                      \
+    ninth = RB81;                                                                    \
+}
+
+#else
+
+// no Wheelwriter attached (for running in the simulator, see bench.bat): every word is
+// sent at once, and the acknowledge comes at once. setting TI1 and RI1 runs uart1_isr()
+// for both, as the real BUS would, so that the simulator times it. the words received
+// are played by stub.c, which leaves each one in stubWord; the acknowledge is the zero
+// left behind.
+extern volatile __data unsigned int stubWord;
+
+#define HAL_WW_TX(w) TI1 = 1
+
+#define HAL_WW_WAIT_ACK() {                                                          \
+    RI1 = 1;                                                                         \
+    HAL_WAIT(!waitingForAcknowledge);                                                \
+}
+
+#define HAL_WW_RX(lo,ninth) {                                                        \
+    lo = stubWord & 0xFF;                                                            \
+    ninth = stubWord >> 8;                                                           \
+    stubWord = 0;                                                                    \
+}
+
+#endif
+
+// read a byte of the flash (code memory)
+#define HAL_FLASH_READ(a) (((__code unsigned char *)0)[a])
+
+// in-application programming: the address (high byte first) and the data are loaded into
+// FDATA, then the command is written to FCNTL under timed access. the CPU waits while FBUSY
+// is set. interrupts are held off because the ISRs run from the flash being programmed,
+// and left as the caller had them.
+#define HAL_FLASH_CMD(cmd,a,d) {                                                     \
+    __bit halEA = EA;                                                                \
+    EA = 0;                                                                          \
+    FDATA = (a) >> 8;                                                                \
+    FDATA = (a) & 0xFF;                                                              \
+    FDATA = (d);                                                                     \
+    TA = 0xAA;                                                                       \
+    TA = 0x55;                                                                       \
+    FCNTL = (cmd);                                                                   \
+    while (FCNTL & FBUSY);                                                           \
+    EA = halEA;                                                                      \
+}
+
+#else
+
+#include "hal_host.h"
+
+#endif
+
+// FCNTL flash commands (see HAL_FLASH_CMD). the DS89C440 has 32K of flash in 512 byte pages.
+#define FLASH_PROGRAM 0x00                // program one byte
+#define FLASH_ERASE   0x08                // erase the page holding the address
+#define FBUSY         0x80                // FCNTL.7, set while a command is in progress
+
+// read timer 2 (started by stats_init(), 1 microsecond per count) into 'v'.
+// if the low byte overflowed between the two reads, read it again.
+#define HAL_TIMER2_READ(v) {                                                         \
+    v = TH2;                                                                         \
+    v = (v << 8) | TL2;                                                              \
+    if ((unsigned char)(v >> 8) != TH2)                                              \
+        v = ((unsigned int)TH2 << 8) | TL2;                                          \
+}
+
+#endif
@@ -0,0 +1,34 @@
+//  Job journal for resuming after a watchdog reset
+//  for the Small Device C Compiler (SDCC)
+//
+//  Kept in uninitialized internal MOVX SRAM (like the trace ring) together with the serial 0
+//  receive buffer, so that after a watchdog reset the job can pick up where it left off.
+//  The state is committed after each character from the serial or parallel port has been
+//  completely printed; 'check' covers the committed fields. A job that keeps resetting the
+//  processor without getting any further is given up after JOURNALTRIES resets.
+
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#define JOURNALKEY 0x5A                                     // marks the journal as valid
+#define JOURNALTRIES 3                                      // watchdog resets in a row without progress before the job is given up
+
+typedef struct {
+    unsigned char key;                                      // JOURNALKEY when the journal is valid
+    unsigned char busy;                                     // EV_SERIAL or EV_LPT while printing a character from that port, otherwise 0
+    unsigned char rxHead;                                   // serial 0 receive write index, kept up to date by uart0_isr()
+    unsigned char rxTail;                                   // serial 0 receive read index after the last committed character
+    unsigned int  uSpaceCount;                              // carrier position
+    unsigned char column;
+    unsigned char attribute;
+    unsigned char escape;                                   // escape sequence state
+    unsigned char uSpacesPerChar;                           // pitch
+    unsigned char uLinesPerLine;
+    unsigned char tabStop;
+    unsigned char check;                                    // JOURNALKEY plus the sum of rxTail through tabStop
+    unsigned char tries;                                    // watchdog resets since the last committed character
+} journal_t;
+
+extern __xdata volatile journal_t journal;
+
+#endif
@@ -1,11 +1,13 @@
 // Keyboard functions
 // for the Small Device C Compiler (SDCC)
 
-#include <compiler.h>    // Please download this header file on this website (https://csy-tvgo.github.io/Keil-C51-C-to-SDCC-C-Converter/index_en.html).
 #include <stdio.h>
-#include "reg420.h"
+#include "hal.h"
 #include "scancodes.h"
 #include "keycodes.h"
+#include "prof.h"
+#include "sched.h"
+#include "stats.h"
 
 #define FALSE 0
 #define TRUE  1
@@ -14,12 +16,6 @@
 #define ON  1
 #define OFF 0
 
-// pins used for PS/2 interface
-SBIT(kb_clock_out,0x90,4);                                  // pin 5
-SBIT(kb_data_out,0x90,5);                                   // pin 6
-SBIT(kb_data_in,0x90,6);                                    // pin 7
-SBIT(kb_clock_in,0xB0,3);                                   // pin 13
-
 // variables for keyboard...
 __bit kb_ctrl;                                              // control key is pressed
 __bit kb_alt;                                               // alt key is pressed
@@ -37,9 +33,11 @@ void kb_isr(void) __interrupt(2) __using(2) {
     static __bit kb_parity = 0;
     static unsigned char recdbits = 0;
 
+   PROF_BEGIN(PROF_KB_ISR);
    switch (kb_bitcount) {
       case 0:                                               // start bit
          if (!kb_data_in) {                                 // if start bit is low
+            kb_parity = 0;                                  // (a scancode cut short by kb_hold() may have left it set)
             kb_bitcount++;
          }
           break;
@@ -66,14 +64,20 @@ void kb_isr(void) __interrupt(2) __using(2) {
          break;
       case 10:                                              // stop bit
          if (kb_data_in && kb_parity) {                     // if stop bit is high and parity is odd
-            kb_buf[kb_in] = recdbits;                       // store the scancode in the buffer
-            kb_in = ++kb_in & 0x0F;
+            if (((kb_in+1) & 0x0F) == kb_out)               // the queue is full (another source owns the job), drop the
+               ++stats.kbOverruns;                          // scancode rather than wrap around to an empty queue
+            else {
+               kb_buf[kb_in] = recdbits;                    // store the scancode in the buffer
+               kb_in = ++kb_in & 0x0F;
+               sched_post(EV_KEY);
+            }
          }
          kb_bitcount = 0;
          recdbits = 0;
          kb_parity = 0;
          break;
    }
+   PROF_END(PROF_KB_ISR);
 }
 
 // ---------------------------------------------------------------------------
@@ -83,18 +87,45 @@ __bit kb_scancode_avail(void) {
     return (kb_in != kb_out);
 }
 
+// ---------------------------------------------------------------------------
+// returns the space remaining in the keyboard queue.
+// ---------------------------------------------------------------------------
+unsigned char kb_free(void) {
+    return 15-((kb_in-kb_out) & 0x0F);
+}
+
 // ---------------------------------------------------------------------------
 // returns one scancode from the keyboard queue. waits until one is available if necessary.
 // ---------------------------------------------------------------------------
 unsigned char kb_get_scancode(void) {
     unsigned char buf;
 
-    while(kb_in == kb_out);                                 // wait until a character is available
+    HAL_WAIT(kb_in != kb_out);                              // wait until a character is available
     buf = kb_buf[kb_out];
     kb_out = ++kb_out & 0x0F;
     return(buf);
 }
 
+// ---------------------------------------------------------------------------
+// hold the keyboard off by pulling the clock line low, before holding off the
+// interrupts for a while, and let it go afterwards. a keyboard held off keeps
+// its keys, and sends a scancode cut short by the hold again from the start.
+// ---------------------------------------------------------------------------
+void kb_hold(void) {
+   unsigned char i;
+
+   EX1 = 0;                                                 // pulling the clock low isn't a bit from the keyboard
+   kb_clock_out = 0;                                        // pull the clock line low
+   for (i=0;i<50;i++);                                      // (50*5)+3 cycles = 253 microseconds, more than the 100 the keyboard needs to notice
+}
+
+void kb_release(void) {
+   kb_clock_out = 1;                                        // release the clock line
+   kb_bitcount = 0;                                         // the scancode cut short (if any) comes again
+   IE1 = 0;                                                 // forget the edge made by kb_hold()
+   EX1 = 1;
+}
+
 // ---------------------------------------------------------------------------
 // Send a command to the keyboard, return TRUE if acknowledge (0xFA) received from keyboard
 //
@@ -115,9 +146,9 @@ unsigned char kb_get_scancode(void) {
 unsigned char kb_send_cmd(unsigned char kbcmd) {
    __bit txbit,paritybit;
    unsigned char c,i;
-   unsigned int k;
+   unsigned short k;                                        // 16 bits, the timeouts below rely on it wrapping to zero
 
-   while (kb_bitcount);                                     // don't send while a character is being received
+   HAL_WAIT(!kb_bitcount);                                  // don't send while a character is being received
    kb_clock_out = 0;                                        // pull the clock line low
    for (i=0;i<50;i++);                                      // (50*5)+3 cycles = 253 microseconds delay
    kb_data_out = 0;                                         // pull the data line low
@@ -143,21 +174,21 @@ unsigned char kb_send_cmd(unsigned char kbcmd) {
       }
 
       kbcmd >>= 1;                                          // shift bits to the right
-      while(!kb_clock_in);                                  // wait until clock line goes high
-      while(kb_clock_in);                                   // wait until clock line goes low
+      HAL_WAIT(kb_clock_in);                                // wait until clock line goes high
+      HAL_WAIT(!kb_clock_in);                               // wait until clock line goes low
    }
 
    kb_data_out = paritybit;                                 // send parity bit
-   while(!kb_clock_in);                                     // wait until clock line goes high
-   while(kb_clock_in);                                      // wait until clock line goes low
+   HAL_WAIT(kb_clock_in);                                   // wait until clock line goes high
+   HAL_WAIT(!kb_clock_in);                                  // wait until clock line goes low
 
    kb_data_out = 1;                                         // send stop bit
-   while(kb_data_in);                                       //wait until data line goes low
-   while(kb_clock_in);                                      //wait until clock line goes low
+   HAL_WAIT(!kb_data_in);                                   //wait until data line goes low
+   HAL_WAIT(!kb_clock_in);                                  //wait until clock line goes low
 
    // wait for ack from keyboard
-   while(!kb_clock_in);                                     //wait until clock line goes high
-   while(!kb_data_in);                                      //wait until data line goes high
+   HAL_WAIT(kb_clock_in);                                   //wait until clock line goes high
+   HAL_WAIT(kb_data_in);                                    //wait until data line goes high
 
    k = 0;
    while(++k && (kb_in == kb_out));                         // wait until the keyboard replies
@@ -315,6 +346,8 @@ unsigned char kb_decode_scancode(unsigned char scancode) {
                 case 0x83:
                     return(PS2_KEY_F7);
                 default:
+                    if (scancode > 0x7F)                    // past the end of the tables (BAT, acknowledge, resend, error)
+                        return(0);
                     if (kb_shift && !(kb_leds & CAPS_LOCK)){// shift but not caps lock
                         return(shifted[scancode]);
                     }
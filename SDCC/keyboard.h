@@ -6,7 +6,10 @@
 void kb_isr(void) __interrupt(2) __using(2);
 void kb_init(void);
 __bit kb_scancode_avail(void);
+unsigned char kb_free(void);
 unsigned char kb_get_scancode(void);
+void kb_hold(void);
+void kb_release(void);
 unsigned char kb_send_cmd(unsigned char kbcmd);
 unsigned char kb_decode_scancode(unsigned char scancode);
 __bit kb_ctrl_pressed(void);
@@ -0,0 +1,189 @@
+//  IEEE 1284 nibble mode reverse channel for the parallel port
+//  for the Small Device C Compiler (SDCC)
+//
+//  The parallel port normally only receives (compatibility mode, see ex0_isr() and task_lpt()
+//  in main.c). With the IEEE 1284 lines wired to the spare pins (see hal.h) and turned on by
+//  <ESC><i><n>, the host can negotiate nibble mode and read back either the status line that
+//  ENQ returns on serial 0 or the printer's device ID. The four status lines nFault, Select,
+//  PError and Busy carry the data four bits at a time, handshaken with nAutoFd (HostBusy) and
+//  nAck (PtrClk). The "event" numbers in the comments are the ones in the standard.
+//
+//  The host expects each step of the negotiation to be answered within about 35 milliseconds,
+//  longer than a task may take while printing, so the negotiation is answered from the
+//  interrupts: lpt_poll() from the timer 0 tick, every 25 milliseconds while the reverse
+//  channel is on, and the extensibility byte latched by ex0_isr(). nSelectIn and nAutoFd are
+//  on T0 and T1 (P3.4 and P3.5), not on interrupt pins, and timer 1 makes the baud rate, so
+//  the tick is what notices them. The transfer that follows is paced by the host and is left
+//  to task_1284() in the main loop.
+
+#include "hal.h"
+#include "config.h"
+#include "sched.h"
+#include "lpt1284.h"
+
+#define FALSE 0
+#define TRUE  1
+#define LOW   0
+#define HIGH  1
+
+extern volatile unsigned char timeout;                      // decremented every 50 milliseconds (see main.c)
+
+__bit lpt_active = FALSE;                                   // in IEEE 1284 mode, the strobes aren't data
+__bit lpt_reverse = FALSE;                                  // putchar() sends to the host through lpt_put()
+__bit lptFailed;                                            // the host stopped answering or ended the transfer
+__bit lptPending;                                           // lptByte waits to be sent
+__bit lptBusy;                                              // Busy before the negotiation
+unsigned char lptByte;
+volatile unsigned char lptStep = LPT_COMPAT;                // how far the interrupts have answered the negotiation
+volatile unsigned char lptExt;                              // the extensibility byte, latched by ex0_isr()
+
+__code char lptID[] = "MFG:IBM;MDL:Wheelwriter;CMD:DIABLO630;CLS:PRINTER;DES:IBM Wheelwriter Printer;";
+
+// wait up to LPT_TIMEOUT ticks for 'cond'
+#define LPT_WAIT(cond) {                                                             \
+    timeout = LPT_TIMEOUT;                                                           \
+    HAL_WAIT((cond) || !timeout);                                                    \
+}
+
+// put the status lines back as they are in compatibility mode
+static void lpt_restore(void) {
+    lptStep = LPT_ANSWERED;                                 // lpt_poll() leaves the lines alone until they're restored
+    busyPin = lptBusy;
+    pePin = LOW;                                            // paper in
+    selectPin = HIGH;                                       // on line
+    faultPin = HIGH;                                        // no fault
+    ackPin = HIGH;
+    lpt_active = FALSE;
+    lptStep = LPT_COMPAT;
+}
+
+// wait for nAutoFd (HostBusy) to go to 'level'. FALSE if the host took too long or ended the transfer.
+static __bit lpt_host(unsigned char level) {
+    timeout = LPT_TIMEOUT;
+    HAL_WAIT((autoFdPin == level) || !selectInPin || !timeout);
+    if ((autoFdPin != level) || !selectInPin)
+        lptFailed = TRUE;
+    return !lptFailed;
+}
+
+// send one byte to the host, low nibble first. 'more' tells the host whether another byte follows.
+static void lpt_send(unsigned char b, unsigned char more) {
+    unsigned char i;
+
+    for (i=0; i<2; i++) {
+        if (!lpt_host(LOW))                                 // event 7: the host is ready for a nibble
+            return;
+        faultPin = b & 0x01;                                // event 8: the nibble on nFault, Select, PError and Busy
+        selectPin = b & 0x02;
+        pePin = b & 0x04;
+        busyPin = b & 0x08;
+        ackPin = LOW;                                       // event 9: the nibble is valid
+        if (!lpt_host(HIGH))                                // event 10: the host has read it
+            return;
+        if (i) {
+            faultPin = !more;                               // nDataAvail, low if there's another byte
+            pePin = !more;                                  // AckDataReq follows it
+        }
+        ackPin = HIGH;                                      // event 11
+        b >>= 4;
+    }
+}
+
+//-----------------------------------------------------------
+// set the status lines for compatibility mode. the lines are
+// spare pins (faultPin is dip switch 4), they're only driven
+// once the reverse channel is turned on.
+//-----------------------------------------------------------
+void lpt_init(void) {
+    if (!LPT1284)
+        return;
+    lptBusy = busyPin;
+    lpt_restore();
+}
+
+//-----------------------------------------------------------
+// called from timer0_isr() every 25 milliseconds while the
+// reverse channel is on. answers the steps of the host's
+// negotiation that have a deadline: event 2 when it starts,
+// events 5 and 6 once ex0_isr() has latched the extensibility
+// byte and the host has taken its lines back high (event 4).
+//-----------------------------------------------------------
+void lpt_poll(void) __using(1) {
+    if ((lptStep == LPT_COMPAT) && LPT_NEGOTIATING) {
+        lpt_active = TRUE;                                  // the strobe that latches the extensibility byte isn't data
+        lptBusy = busyPin;
+        pePin = HIGH;                                       // event 2: PError, Select and nFault high, nAck low
+        selectPin = HIGH;
+        faultPin = HIGH;
+        ackPin = LOW;
+        lptStep = LPT_EVENT2;
+        sched_post(EV_LPT);                                 // wake the main loop for task_1284()
+    }
+    else if ((lptStep == LPT_STROBED) && strobePin && autoFdPin && selectInPin) {
+        pePin = LOW;                                        // event 5
+        faultPin = !((lptExt == LPT_NIBBLE) || (lptExt == LPT_DEVICEID)); // nDataAvail, low if there's something to send
+        selectPin = (lptExt == LPT_DEVICEID);               // Xflag: high accepts the device ID, low accepts plain nibble mode or refuses
+        ackPin = HIGH;                                      // event 6
+        lptStep = LPT_ANSWERED;
+    }
+}
+
+//-----------------------------------------------------------
+// finish the host's negotiation, answered by lpt_poll() once
+// lpt_active is set, and return the extensibility byte it
+// sent. returns LPT_FAILED if the host gave up. anything else
+// must be followed by lpt_terminate(), even a mode that was
+// refused. only nibble mode is supported, alone (LPT_NIBBLE)
+// or for the device ID (LPT_DEVICEID).
+//-----------------------------------------------------------
+unsigned char lpt_negotiate(void) {
+    lptPending = FALSE;
+    lptFailed = FALSE;
+    LPT_WAIT((lptStep == LPT_ANSWERED) || !selectInPin);    // events 3 to 6, answered by the interrupts
+    if ((lptStep != LPT_ANSWERED) || !selectInPin) {
+        lpt_restore();
+        return LPT_FAILED;
+    }
+    return lptExt;
+}
+
+//-----------------------------------------------------------
+// send the device ID: two bytes of length, high byte first,
+// which counts them, then the ID itself.
+//-----------------------------------------------------------
+void lpt_device_id(void) {
+    unsigned char i;
+
+    lpt_put(0);
+    lpt_put(sizeof(lptID)+1);                               // sizeof() counts the terminating zero
+    for (i=0; lptID[i]; i++)
+        lpt_put(lptID[i]);
+}
+
+//-----------------------------------------------------------
+// send a byte to the host. each byte is held until the next
+// one (or lpt_terminate()) so the host can be told after it
+// whether there's more to come.
+//-----------------------------------------------------------
+void lpt_put(unsigned char c) {
+    if (lptPending && !lptFailed)
+        lpt_send(lptByte,TRUE);
+    lptByte = c;
+    lptPending = TRUE;
+}
+
+//-----------------------------------------------------------
+// send the last byte, wait for the host to end the transfer
+// and go back to compatibility mode.
+//-----------------------------------------------------------
+void lpt_terminate(void) {
+    if (lptPending && !lptFailed)
+        lpt_send(lptByte,FALSE);
+    lptPending = FALSE;
+    timeout = LPT_IDLE;
+    HAL_WAIT(!selectInPin || !timeout);                     // event 22: nSelectIn low
+    faultPin = HIGH;                                        // event 23
+    ackPin = LOW;                                           // event 24
+    LPT_WAIT(!autoFdPin);                                   // event 25: nAutoFd low
+    lpt_restore();                                          // events 26 and 27
+}
@@ -0,0 +1,38 @@
+//  IEEE 1284 nibble mode reverse channel for the parallel port
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __LPT1284_H__
+#define __LPT1284_H__
+
+// extensibility byte sent by the host during negotiation
+#define LPT_NIBBLE    0x00                                  // nibble mode, the printer returns its status line
+#define LPT_DEVICEID  0x04                                  // nibble mode, the printer returns its device ID
+#define LPT_FAILED    0xFF                                  // returned by lpt_negotiate() when there's nothing to send
+
+// the steps of a negotiation answered from the interrupts (see lpt_poll() and ex0_isr())
+#define LPT_COMPAT    0                                     // compatibility mode, no negotiation
+#define LPT_EVENT2    1                                     // event 2 answered, waiting for the extensibility byte
+#define LPT_STROBED   2                                     // event 3, the extensibility byte is latched in lptExt
+#define LPT_ANSWERED  3                                     // events 5 and 6 answered, the transfer is up to the main loop
+
+#define LPT_TIMEOUT   2                                     // 50 millisecond ticks the host has to take each step
+#define LPT_IDLE      20                                    // ticks to wait for the host to end the transfer
+
+// the host is asking to negotiate: nSelectIn high with nAutoFd low
+#define LPT_NEGOTIATING (selectInPin && !autoFdPin)
+
+#define LPT1284 (cfg.options & CFG_1284)
+
+extern __bit lpt_active;
+extern __bit lpt_reverse;
+extern volatile unsigned char lptStep;
+extern volatile unsigned char lptExt;
+
+void lpt_init(void);
+void lpt_poll(void) __using(1);
+unsigned char lpt_negotiate(void);
+void lpt_device_id(void);
+void lpt_put(unsigned char c);
+void lpt_terminate(void);
+
+#endif
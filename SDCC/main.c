@@ -65,22 +65,36 @@
 //----------------------------------------------------------------------------------------------------------
 // switch 1    off - linefeed only upon receipt of linefeed character (0x0A)
 //             on  - auto linefeed; linefeed is performed with each carriage return (0x0D)
+//             (unless overridden by <ESC><l><n> and saved with <ESC><^Z><w>)
 // switch 2    not used
-// switch 3    not used
-// switch 4    not used
+// switch 3    off - quality printing
+//             on  - draft printing; bold struck once, underlining struck in one pass per run (see <ESC><q><n>)
+// switch 4    not used, leave it off when the IEEE 1284 lines are wired (its pin is nFault, see <ESC><i><n>)
 //----------------------------------------------------------------------------------------------------------
 
 #include <stdio.h>
 #include <ctype.h>
 #include <stdlib.h>
-#include "reg420.h"
+#include "hal.h"
 #include "uart12.h"
 #include "watchdog.h"
 #include "control.h"
 #include "keyboard.h"
 #include "keycodes.h"
 #include "wheelwriter.h"
-#include "compiler.h"
+#include "trace.h"
+#include "prof.h"
+#include "sched.h"
+#include "stats.h"
+#include "config.h"
+#include "journal.h"
+#include "tty.h"
+#include "lpt1284.h"
+#include "spool.h"
+#include "forms.h"
+#include "flash.h"
+#include "stub.h"
+#include <stddef.h>
 
 #define CR    0x0D
 #define LF    0x0A
@@ -96,8 +110,6 @@
 #define ON 0                            // 0 turns the LEDs on
 #define OFF 1                           // 1 turns the LEDs off
 
-#define NOP() __asm NOP __endasm
-
 // used to display byte as binary
 #define PATTERN " %c%c%c%c%c%c%c%c\n"
 #define TO_BINARY(byte)  \
@@ -111,29 +123,56 @@
   (byte & 0x01 ? '1' : '0')
   
 // 12,000,000 Hz/12 = 1,000,000 Hz = 1.0 microsecond clock period
-// 50 milliseconds per interval/1.0 microseconds per clock = 50,000 clocks per interval
-#define RELOADHI (65536-50000)/256
-#define RELOADLO (65536-50000)&255
+// 25 milliseconds per interval/1.0 microseconds per clock = 25,000 clocks per interval, two intervals per tick
+#define RELOADHI (65536-25000)/256
+#define RELOADLO (65536-25000)&255
 #define ONESEC 20                         // 20*50 milliseconds = 1 second
 
-__sbit __at (0x80) switch1;               // dip switch connected to pin 39 0=on, 1=off (auto LF after CR if on) 
-__sbit __at (0x81) switch2;               // dip switch connected to pin 38 0=on, 1=off (not used)
-__sbit __at (0x82) switch3;               // dip switch connected to pin 37 0=on, 1=off (not used)
-__sbit __at (0x83) switch4;               // dip switch connected to pin 36 0=on, 1=off (not used)
+// linefeed with each carriage return: as set by <ESC><l><n>, otherwise by switch 1
+#define AUTOLF (((cfg.options & CFG_LF_MASK) == CFG_LF_ON) || \
+                (((cfg.options & CFG_LF_MASK) == CFG_LF_SWITCH) && !switch1))
+
+// draft printing: selected by <ESC><q><n> or switch 3
+#define DRAFT ((cfg.options & CFG_DRAFT) || !switch3)
 
-__sbit __at (0x84) redLED;                // red   LED connected to pin 35 0=on, 1=off
-__sbit __at (0x85) amberLED;              // amber LED connected to pin 34 0=on, 1=off
-__sbit __at (0x86) greenLED;              // green LED connected to pin 33 0=on, 1=off
+// strike ordering: selected by <ESC><o><n>. not for the keyboard, where each letter should appear as it's typed
+#define ORDER ((cfg.options & CFG_ORDER) && (jobOwner != SRC_KEY))
 
-__sbit __at (0x90) ackPin;                // Acknowledge output for LPT port on pin 1
-__sbit __at (0x91) busyPin;               // Busy output for LPT port on pin 2
+// most items each task handles before it lets the other tasks run
+#define KEY_BUDGET    2                   // keys from the ps/2 keyboard
+#define BUS_BUDGET    4                   // words from the Wheelwriter BUS
+#define SERIAL_BUDGET 8                   // characters from serial 0
+#define SPOOL_BUDGET  8                   // characters of the spooled job
+#define FORM_BUDGET   8                   // characters of the form being printed
+
+// sources of characters to print. one at a time owns the job (see job_claim()).
+#define SRC_SERIAL    0
+#define SRC_LPT       1
+#define SRC_KEY       2
+#define SOURCES       3
+#define SRC_NONE      0xFF
+#define JOB_IDLE      ONESEC*10           // a job ends after 10 seconds without a character from its source
+#define HELD_IDLE     ONESEC/4            // strikes held back are made once the source has sent nothing for 1/4 second
+#define TTY_QUIET     ONESEC              // in terminal mode the host's output waits until the Wheelwriter's keyboard has been quiet this long
 
 __bit errorLED = FALSE;                 // flag that makes the red LED flash when TRUE
 __bit initializing = TRUE;              // flag that makes all three LEDs flash during initialization
+__bit wheelChanged = FALSE;             // the printwheel was changed since the last status (see check_printwheel())
+__bit wheelFlush = FALSE;               // the printwheel was changed with strikes held back, make them when the main loop is idle
+__bit spoolPaused = FALSE;              // waiting for a key on the ps/2 keyboard before the next copy (see task_spool())
 
 unsigned char attribute = 0;            // bit 0=bold, bit 1=continuous underline, bit 2=multiple word underline
 unsigned char column = 1;               // current print column (1=left margin)
 unsigned char tabStop = 5;              // horizontal tabs every 5 spaces (every 1/2 inch)
+unsigned char escape = 0;               // escape sequence state of print_character()
+unsigned char jobOwner = SRC_NONE;      // source that owns the current job
+volatile unsigned char jobTimer = 0;    // decremented every 50 milliseconds, the job is over when it reaches zero
+unsigned char spoolCopies = 0;          // copies of the spooled job still to print
+unsigned int spoolPos;                  // next character of the spooled job
+volatile unsigned char ttyTimer = 0;    // decremented every 50 milliseconds, the host's output may print when it reaches zero
+volatile unsigned char wheelTimer = 0;  // decremented every 50 milliseconds, nothing prints until it reaches zero or the printwheel is reported
+__xdata unsigned char ctxEscape[SOURCES];    // escape state of each source while it doesn't own the job
+__xdata unsigned char ctxAttribute[SOURCES]; // attribute of each source while it doesn't own the job
 volatile unsigned char timeout = 0;     // decremented every 50 milliseconds, used for detecting timeouts
 volatile unsigned char hours = 0;       // uptime hours
 volatile unsigned char minutes = 0;     // uptime minutes
@@ -142,10 +181,12 @@ volatile unsigned char seconds = 0;     // uptime seconds
 extern unsigned char uSpacesPerChar;    // defined in wheelwriter.c
 extern unsigned char uLinesPerLine;     // defined in wheelwriter.c
 extern unsigned int  uSpaceCount;       // defined in wheelwriter.c
+extern unsigned int  uLineCount;        // defined in wheelwriter.c
 
 // uninitialized variables in xdata RAM, contents unaffected by reset
 __xdata volatile unsigned char __at(0x03F0) wdResets;    // count of watchdog resets
 __xdata volatile unsigned char __at(0x03F1) printWheel;  // 0x08: PS; 0x10: 15P; 0x20: 12P; 0x40: 10P; 0x21: none
+__xdata volatile journal_t __at(0x03E2) journal;         // job state for resuming after a watchdog reset (see journal.h)
 
 __code char banner[]   = "\n\nWheelwriter Printer Version 3.7\n"
                          "for Maxim DS89C440 MCU and SDCC\n"
@@ -153,6 +194,7 @@ __code char banner[]   = "\n\nWheelwriter Printer Version 3.7\n"
                          "Copyright 2019-2024 Jim Loos\n";
 
 __code char help1[]   = "\n\nControl characters:\n"
+                        "  EOT 0x04        end of job\n"
                         "  BEL 0x07        spins the printwheel\n"
                         "  BS  0x08        non-destructive backspace\n"
                         "  TAB 0x09        horizontal tab\n"
@@ -176,32 +218,77 @@ __code char help2[]   = "\n\nPrinter control not part of the Diablo 630 emulatio
                         "  <ESC><d>        selects micro paper down\n"
                         "  <ESC><b>        selects broken underlining\n"
                         "  <ESC><l><n>     auto linefeed on or off\n"
+                        "  <ESC><q><n>     draft printing on or off\n"
+                        "  <ESC><o><n>     strike ordering on or off\n"
+                        "  <ESC><t><n>     terminal mode off, raw or cooked (n=0-2)\n"
+                        "  <ESC><i><n>     IEEE 1284 reverse channel on or off\n"
+                        "  <ESC><k><n>     PS/2 keyboard to the host on or off (or Pause)\n"
+                        "  <ESC><s>        spool the job\n"
+                        "  <ESC><c><n>     print n copies of the spooled job (n=1-9)\n"
+                        "  <ESC><F><n>     define form n (n=1-9, 0 erases them all)\n"
+                        "  <ESC><f><n>     fill in and print form n\n"
                         "  <ESC><p>        selects Pica pitch (10 cpi)\n"
                         "  <ESC><e>        selects Elite pitch (12 cpi)\n"
                         "  <ESC><m>        selects Micro Elite pitch (15 cpi)\n"
                         "\nDiagnostics/debugging:\n"
                         "  <ESC><^Z><a>    show version information\n"
+                        "  <ESC><^Z><d>    restore the default settings\n"
                         "  <ESC><^Z><e><n> flashing red LED on or off\n"
+                        "  <ESC><^Z><k><n> serial bit rate 2400/4800/9600/19200 (n=0-3) after reset\n"
                         "  <ESC><^Z><p><n> show the value of Port n (0-3)\n"
                         "  <ESC><^Z><r>    reset the MCU\n"
+                        "  <ESC><^Z><q>    show the status (same as ENQ)\n"
+                        "  <ESC><^Z><s>    show the performance counters\n"
+                        "  <ESC><^Z><t>    show the trace of recent events\n"
                         "  <ESC><^Z><u>    show the uptime\n"
-                        "  <ESC><^Z><v>    show variables\n";
+                        "  <ESC><^Z><v>    show variables\n"
+                        "  <ESC><^Z><w>    save the settings in flash\n";
 
 //------------------------------------------------------------
-// Timer 0 ISR: interrupt every 50 milliseconds, 20 times per second
+// Timer 0 ISR: interrupt every 25 milliseconds, a tick every 50 milliseconds, 20 times per second
 //------------------------------------------------------------
 void timer0_isr(void) __interrupt(1) __using(1) {
     static unsigned char ticks = 0;
+    static unsigned char beats = 0;
+    static __bit half = 0;
 
+    PROF_BEGIN(PROF_TIMER0_ISR);
+    PROF_LATENCY();                 // before the reload, timer 0 has counted the time since it overflowed
     TL0 = RELOADLO;              // load timer 0 low byte
     TH0 = RELOADHI;                 // load timer 0 high byte
 
+    if (LPT1284)                    // the IEEE 1284 negotiation has to be answered within 35 milliseconds
+        lpt_poll();
+
+#ifdef BUS_STUB
+    stub_tick();                    // the Function Board and the PS/2 keyboard in the simulator (see stub.c)
+#endif
+
+    half = !half;
+    if (half) {                     // the rest only every other interrupt, every 50 milliseconds
+        PROF_END(PROF_TIMER0_ISR);
+        return;
+    }
+
     if (timeout)                    // countdown value for detecting timeouts
         --timeout;
 
+    if (jobTimer && !--jobTimer)    // the job has been idle too long, let the other sources have a turn
+        sched_post(EV_KEY|EV_SERIAL|EV_LPT);
+
+    if (ttyTimer && !--ttyTimer)    // the Wheelwriter's keyboard has gone quiet, print the host's output
+        sched_post(EV_SERIAL);
+
+    if (wheelTimer && !--wheelTimer) // the Printer Board never reported the printwheel, print with the cached one
+        sched_post(EV_KEY|EV_SERIAL|EV_LPT);
+
     if (initializing) {             // flash all three LEDs while initializing
        amberLED = greenLED = redLED = (ticks < 10);
     }
+    else if (++beats == 5) {        // every 250 milliseconds...
+       beats = 0;
+       greenLED = !greenLED;        // toggle the green LED (heartbeat)
+    }
 
     if(++ticks == 20) {             // if 20 ticks (one second) have elapsed...
         ticks = 0;
@@ -217,6 +304,7 @@ void timer0_isr(void) __interrupt(1) __using(1) {
             }
         }
     }
+    PROF_END(PROF_TIMER0_ISR);
 }
 
 //------------------------------------------------------------------------------------------
@@ -230,7 +318,14 @@ void timer0_isr(void) __interrupt(1) __using(1) {
 //------------------------------------------------------------------------------------------
 void ex0_isr(void) __interrupt(0) __using(2) {
    IE0 = 0;                         // clear EX0 interrupt flag
-    busyPin = HIGH;                 // when the host pulls strobe low, set busy high
+    if (!lpt_active) {              // the strobes of an IEEE 1284 negotiation aren't data
+        busyPin = HIGH;             // when the host pulls strobe low, set busy high
+        sched_post(EV_LPT);
+    }
+    else if (lptStep == LPT_EVENT2) { // event 3: latch the extensibility byte, lpt_poll() answers it
+        lptExt = P2;
+        lptStep = LPT_STROBED;
+    }
 }
 
 // table used by parseWWdata function below for converting printwheel characters to ASCII
@@ -248,13 +343,137 @@ const char __code printwheel2ASCII[96] = {
 // x    q    v    z    w    j    .    y    b    g    u    p    i    t    o    e
   0x78,0x71,0x76,0x7A,0x77,0x6A,0x2E,0x79,0x62,0x67,0x75,0x70,0x69,0x74,0x6F,0x65};
 
+#define NO_PRINTWHEEL 0x21                                  // the Printer Board's answer with no printwheel installed
+
+// a printwheel whose pitch is known
+#define KNOWN_PRINTWHEEL(w) (((w) == 0x08) || ((w) == 0x10) || ((w) == 0x20) || ((w) == 0x40))
+
+//-----------------------------------------------------------
+// set the pitch and tab stops for the printwheel reported by
+// the Printer Board
+//-----------------------------------------------------------
+void set_printwheel(unsigned char wheel) {
+    printWheel = wheel;
+    switch (wheel) {
+        case 0x008:
+            uSpacesPerChar = 10;
+            uLinesPerLine = 16;
+            tabStop = 6;                                    // tab stops every 6 characters (every 1/2 inch)
+            printf("\nPS printwheel\n");
+            break;
+        case 0x010:
+            uSpacesPerChar = 8;
+            uLinesPerLine = 12;
+            tabStop = 7;                                    // tab stops every 7 characters (every 1/2 inch)
+            printf("\n15P printwheel\n");
+            break;
+        case 0x020:
+            uSpacesPerChar = 10;
+            uLinesPerLine = 16;
+            tabStop = 6;                                    // tab stops every 6 characters (every 1/2 inch)
+            printf("\n12P printwheel\n");
+            break;
+        case 0x021:
+            uSpacesPerChar = 10;
+            uLinesPerLine = 16;
+            tabStop = 6;                                    // tab stops every 6 characters (every 1/2 inch)
+            printf("\nNo printwheel\n");
+            break;
+        case 0x040:
+            uSpacesPerChar = 12;
+            uLinesPerLine = 16;
+            tabStop = 5;                                    // tab stops every 5 characters (every 1/2 inch)
+            printf("\n10P printwheel\n");
+            break;
+        default:
+            uSpacesPerChar = 10;
+            uLinesPerLine = 16;
+            tabStop = 6;                                    // tab stops every 6 characters (every 1/2 inch)
+            printf("\nUnable to determine printwheel. Assuming 12P.\n");
+    }
+}
+
+//-----------------------------------------------------------
+// the Printer Board reported printwheel 'wheel'. switch to it
+// if it's not the one in use, and cache it in flash for the
+// next power on if it's not the one cached there (the saved
+// settings are left as they were, see cfg_save_wheel()). a change
+// after start up (the printwheel swapped with the power on)
+// is announced on the console and flagged in the status.
+//-----------------------------------------------------------
+void check_printwheel(unsigned char wheel) {
+    if (wheel != printWheel) {
+        if (printWheel && !initializing) {
+            wheelFlush = TRUE;                              // strikes held back are made once the BUS is quiet, not during the exchange
+            wheelChanged = TRUE;
+            printf("\nPrintwheel changed");
+        }
+        set_printwheel(wheel);
+    }
+    if ((wheel != cfg.lastWheel) && (wheel != NO_PRINTWHEEL)) // a printwheel taken out isn't worth a flash write
+        cfg_save_wheel(wheel);
+    if (wheelTimer) {                                       // the start up exchange is over, print
+        wheelTimer = 0;
+        sched_post(EV_KEY|EV_SERIAL|EV_LPT);
+    }
+}
+
+//-----------------------------------------------------------
+// use the pitch and tab stops from the configuration
+//-----------------------------------------------------------
+void apply_settings(void) {
+    uSpacesPerChar = cfg.uSpacesPerChar;
+    uLinesPerLine = cfg.uLinesPerLine;
+    tabStop = cfg.tabStop;
+}
+
+//-----------------------------------------------------------
+// a key typed on the Wheelwriter's keyboard. in terminal mode
+// it goes to the host (see tty.c) and the host's output waits
+// until the typing stops, so the printing of one doesn't get
+// mixed up with the other. otherwise it's echoed to the
+// console. DEL is the erase key.
+//-----------------------------------------------------------
+void typewriter_key(unsigned char key) {
+    if (TTY) {
+        ttyTimer = TTY_QUIET;
+        tty_key(key);
+    }
+    else if (key == DEL) {
+        putchar(SPACE);                   // overwrite the character with space
+        putchar(BS);
+    }
+    else
+        putchar(key);
+}
+
 //------------------------------------------------------------------------------------------
 // parses the data stream consisting of the 9 bit words sent by the Function Board
-// on the Wheelwriter BUS to the Printer Board. transmits the decoded ASCII character
-// out through Serial0.
+// on the Wheelwriter BUS to the Printer Board. passes the decoded keys to typewriter_key()
+// and follows the carrier so that printing picks up where the typing left off.
+//
+// commands decoded:
+//   0x121,0x001                    printwheel query; the Printer Board's answer follows. the
+//                                  Function Board asks again when the printwheel is changed,
+//                                  so the pitch follows a printwheel swapped with the power on
+//   0x121,0x003,code,advance       print. a strike that advances the carrier less than two
+//                                  micro spaces starts a bold (same letter again one micro
+//                                  space on) or underlined (underscore in the same place)
+//                                  character, whose second strike isn't another key
+//   0x121,0x004,code,width         erase (print on the correction tape), the carrier doesn't move
+//   0x121,0x005,lines              paper up (bit 7 set) or down, bits 0-4 micro lines
+//   0x121,0x006,upper,lower        carrier right (bit 7 of upper set) or left, 11 bit micro spaces
+//   0x121,0x007                    spin the printwheel
+// the code key, margin and tab set keys are handled by the Function Board itself and never
+// reach the BUS.
 //------------------------------------------------------------------------------------------
 void parseWWdata(unsigned int WWdata) {
     static char state = 0;
+    static unsigned char code;            // printwheel code of a print or erase command
+    static unsigned char upper;           // direction and upper 3 bits of a carrier move
+    static unsigned char first = 0;       // printwheel code of the first strike of the character
+    static __bit overstrike = FALSE;      // the last strike left the carrier (almost) where it was
+    unsigned int d;
 
     switch (state) {
         case 0:                                   // waiting for first data word from Wheelwriter...
@@ -267,9 +486,7 @@ void parseWWdata(unsigned int WWdata) {
                     state = 2;
                     break;
                 case 0x004:                       // 0x121,0x004 is start of erase sequence
-                    putchar(SPACE);               // overwrite the character with space
-                    putchar(BS);
-                    state = 0;
+                    state = 8;
                     break;
                 case 0x005:                       // 0x121,0x005 is start of vertical movement sequence
                     state = 6;
@@ -277,49 +494,230 @@ void parseWWdata(unsigned int WWdata) {
                 case 0x006:                       // 0x121,0x006 is start of horizontal movement sequence
                     state = 3;
                     break;
-                default:
+                case 0x001:                       // 0x121,0x001 is the Function Board asking for the printwheel
+                    state = 7;
+                    break;
+                default:                          // 0x121,0x007 spins the printwheel, nothing to decode
                     state = 0;
             } // switch (WWdata)
             break;
         case 2:                                   // 0x121,0x003 has been received...
-            if (WWdata)                           // 0x121,0x003,printwheel code
-               putchar(printwheel2ASCII[(WWdata-1)]);
-            else
-               putchar(SP);                       // 0x121,0x003,0x000 is the sequence for SPACE
+            code = WWdata;                        // 0x121,0x003,printwheel code (0x000 is SPACE)
+            state = 9;
+            break;
+        case 9:                                   // 0x121,0x003,code has been received, WWdata is the advance...
+            uSpaceCount += WWdata;
+            if (!(overstrike && code && ((code == 0x04F) || (code == first)))) {
+               first = code;                      // not the underscore or second strike of a bold or underlined character
+               typewriter_key(code ? printwheel2ASCII[(code-1)] : SP);
+            }
+            overstrike = code && (WWdata < 2);
             state = 0;
             break;
-        case 3:                                   // 0x121,0x006 has been received...
-            if (WWdata & 0x080)                   // if bit 7 is set...
-               state = 4;                         // 0x121,0x006,0x080 is horizontal movement to the right...
-            else                                  // else...
-               state = 5;                         // 0x121,0x006,0x000 is horizontal movement to the left...
+        case 8:                                   // 0x121,0x004 has been received, WWdata is the printwheel code...
+            state = 10;
             break;
-        case 4:                                    // 0x121,0x006,0x080 has been received, move carrier to the right...
+        case 10:                                  // 0x121,0x004,code has been received, WWdata is the character's width...
+            overstrike = FALSE;                   // (the carrier stays where it is, see ww_erase_strike())
+            typewriter_key(DEL);
             state = 0;
-            if (WWdata>uSpacesPerChar)            // if more than one space, must be tab
-                putchar(TAB);
-            else
-                putchar(SPACE);
             break;
-        case 5:                                   // 0x121,0x006,0x000 has been received, move carrier to the left...
-            if (WWdata == uSpacesPerChar)
-               putchar(BS);
+        case 3:                                   // 0x121,0x006 has been received...
+            upper = WWdata;                       // bit 7 is set for movement to the right, bits 0-2 are the upper 3 bits
+            state = 4;
+            break;
+        case 4:                                   // 0x121,0x006,upper has been received, WWdata is the lower 8 bits...
+            d = ((upper & 0x07)<<8)|WWdata;
+            overstrike = FALSE;
+            if (upper & 0x080) {                  // move carrier to the right...
+               uSpaceCount += d;
+               if (d>uSpacesPerChar)              // if more than one space, must be tab
+                   typewriter_key(TAB);
+               else
+                   typewriter_key(SPACE);
+            }
+            else {                                // move carrier to the left...
+               uSpaceCount = (d < uSpaceCount) ? uSpaceCount-d : 0;
+               if (d == uSpacesPerChar)
+                   typewriter_key(BS);
+            }
             state = 0;
             break;
         case 6:                                   // 0x121,0x005 has been received...
+            if (WWdata & 0x080)                   // the paper moved up (bit 7 set) or down, keep the count for the correction memory and forms
+               uLineCount += WWdata&0x1F;
+            else
+               uLineCount -= WWdata&0x1F;
             if ((WWdata&0x1F) == uLinesPerLine)
-               putchar(CR);                       // 0x121,0x005,0x090 is the sequence for paper up one line (for 10P, 12P and PS printwheels)
+               typewriter_key(CR);                // 0x121,0x005,0x090 is the sequence for paper up one line (for 10P, 12P and PS printwheels)
+            state = 0;
+            break;
+        case 7:                                   // 0x121,0x001 has been received...
+            if (KNOWN_PRINTWHEEL(WWdata) || (WWdata == NO_PRINTWHEEL))
+               check_printwheel(WWdata);          // the Printer Board's answer, confirms or corrects the printwheel in use
             state = 0;
     }   // switch (state)
+    column = uSpaceCount/uSpacesPerChar+1;        // where the typing left the carrier
+}
+
+//-----------------------------------------------------------
+// echo a printed character to the console, except in terminal
+// mode or with the PS/2 keyboard's keys going to the host,
+// where the console is the host and would take it as input
+//-----------------------------------------------------------
+void echo(unsigned char c) {
+    if (!TTY && !KBHOST)
+        putchar(c);
+}
+
+//-----------------------------------------------------------
+// job arbitration. the source that prints first owns the job
+// until it ends with EOT or goes JOB_IDLE without a character.
+// meanwhile the other sources keep their characters: serial 0
+// in its buffer (RTS pauses the host when it fills), the LPT
+// port by holding Busy high, the ps/2 keyboard in its buffer.
+// each source has its own escape state and attribute so a job
+// can't pick up a half finished escape sequence from another.
+//
+// returns TRUE if 'src' may print now. none may while copies
+// of the spooled job or a form are being printed, or while the
+// Function Board and Printer Board are still starting up.
+//-----------------------------------------------------------
+__bit job_claim(unsigned char src) {
+    if (spoolCopies || form_printing || wheelTimer)
+        return FALSE;
+    if (jobOwner != src) {
+        if ((jobOwner != SRC_NONE) && jobTimer)             // another source's job is still going
+            return FALSE;
+        if (jobOwner != SRC_NONE) {                         // the first job since reset carries on from the journal
+            ctxEscape[jobOwner] = escape;                   // save the old job's context...
+            ctxAttribute[jobOwner] = attribute;
+            escape = ctxEscape[src];                        // ...and switch to the new one's
+            attribute = ctxAttribute[src];
+            if (column > 1) {                               // start the new job on a new line
+                ww_carriage_return();
+                ww_linefeed();
+                column = 1;
+                echo(CR);
+                echo(LF);
+            }
+        }
+        jobOwner = src;
+    }
+    jobTimer = JOB_IDLE;
+    return TRUE;
+}
+
+//-----------------------------------------------------------
+// end the current job now (EOT). wakes the sources that were
+// waiting for their turn.
+//-----------------------------------------------------------
+void job_end(void) {
+    jobTimer = 0;
+    sched_post(EV_KEY|EV_SERIAL|EV_LPT);
+}
+
+__code char * __code srcNames[SOURCES] = {"serial","lpt","key"};
+
+//-----------------------------------------------------------
+// answer ENQ (0x05) from the host with one line of key=value
+// pairs. ENQ is taken out of the serial 0 stream by uart0_isr()
+// and answered ahead of the characters still waiting, so the
+// host can size its next burst to the free space and poll for
+// the end of a job (send EOT, then ENQ until done=1):
+//   serialfree  space in the serial 0 receive buffer
+//   keyfree     space in the ps/2 keyboard scancode queue
+//   busfree     space in the serial 1 (BUS) receive buffer
+//   lptbusy     1 while a character from the parallel port waits
+//   held        strikes held back, not yet sent to the Printer Board
+//   done        1 when every character received has been printed (and every copy and form)
+//   job         source that owns the job (serial, lpt, key or none)
+//   column, uspace, uline  carrier column, micro spaces from the left
+//               margin and micro lines the paper has moved up since reset
+//   wheel       printWheel (0x08 PS, 0x10 15P, 0x20 12P, 0x40 10P, 0x21 none)
+//   wheelchanged 1 if the printwheel was changed (and the pitch with it) since
+//               the last status
+//   copies      copies of the spooled job still to print
+//   errors      0x01 error LED on, 0x02 no printwheel, 0x04 serial 0 paused
+//               (RTS), 0x08 words from the BUS have been lost
+//-----------------------------------------------------------
+void task_status(void) {
+    unsigned char errors = 0;
+
+    if (errorLED)
+        errors |= 0x01;
+    if (!KNOWN_PRINTWHEEL(printWheel))
+        errors |= 0x02;
+    if (RTS)
+        errors |= 0x04;
+    if (stats.busOverruns)
+        errors |= 0x08;
+    printf("\nSTATUS serialfree=%u keyfree=%u busfree=%u lptbusy=%u held=%u done=%u",
+           (int)uart_free(),(int)kb_free(),(int)ww_data_free(),(int)busyPin,(int)ww_held(),
+           (int)(!uart_char_avail() && !kb_scancode_avail() && !busyPin && !ww_held() && !spoolCopies && !form_printing));
+    printf(" job=%s column=%u uspace=%u uline=%u wheel=0x%02X wheelchanged=%u copies=%u errors=0x%02X\n",
+           (jobOwner == SRC_NONE) ? "none" : srcNames[jobOwner],(int)column,uSpaceCount,uLineCount,
+           (int)printWheel,(int)wheelChanged,(int)spoolCopies,(int)errors);
+    wheelChanged = FALSE;
+}
+
+//-----------------------------------------------------------
+// the queries that uart0_isr() takes out of the serial 0
+// stream, ENQ for the status and <ESC><^Z><s> for the
+// counters. both are answered at once, not after the job
+// that's printing ahead of them.
+//-----------------------------------------------------------
+void task_query(void) {
+    if (uart_stats) {
+        uart_stats = FALSE;
+        stats_dump();
+    }
+    if (uart_enq) {
+        uart_enq = FALSE;
+        task_status();
+    }
+}
+
+//-----------------------------------------------------------
+// the host is negotiating IEEE 1284 nibble mode on the parallel
+// port (see lpt1284.c). send it the status line or the device ID.
+//-----------------------------------------------------------
+void task_1284(void) {
+    unsigned char mode;
+
+    mode = lpt_negotiate();
+    if (mode == LPT_FAILED)
+        return;
+    lpt_reverse = TRUE;                                     // putchar() sends to the parallel port
+    if (mode == LPT_NIBBLE)
+        task_status();
+    else if (mode == LPT_DEVICEID)
+        lpt_device_id();
+    lpt_reverse = FALSE;
+    lpt_terminate();
+}
+
+//-----------------------------------------------------------
+// before each copy of the spooled job: spin the printwheel and
+// wait for a key on the ps/2 keyboard, or CR or EOT from the
+// host, while the paper is changed (see spool_key()).
+//-----------------------------------------------------------
+void spool_pause(void) {
+    ww_flush();
+    ww_spin();
+    spoolPaused = TRUE;
+    printf("\nInsert paper and press a key, Esc to cancel\n");
 }
 
 //------------------------------------------------------------------------------------------
 // The Wheelwriter prints the character and updates the variable 'column'.
 // Carriage return cancels bold and underlining.
-// Linefeeds automatically printed with carriage return if switch 1 is on.
+// Linefeeds automatically printed with carriage return if switch 1 is on (see <ESC><l><n>).
 // The character printed by the Wheelwriter is echoed to the serial port (for monitoring).
 //
 // Control characters:
+//   EOT 0x04    end of job, another source (serial, LPT or keyboard) may print
+//   ENQ 0x05    status query, taken out of the serial 0 stream and answered at once (see task_status())
 //   BEL 0x07    spins the printwheel
 //   BS  0x08    non-destructive backspace
 //   TAB 0x09    horizontal tab to next tab stop
@@ -346,33 +744,85 @@ void parseWWdata(unsigned int WWdata) {
 //   <ESC><p>  selects Pica pitch (10 characters/inch or 12 point)
 //   <ESC><e>  selects Elite pitch (12 characters/inch or 10 point)
 //   <ESC><m>  selects Micro Elite pitch (15 characters/inch or 8 point)
+//   <ESC><l><n> auto linefeed with carriage return on or off (n=1 is on, n=0 is off)
+//   <ESC><q><n> draft printing on or off (n=1 is on, n=0 is off)
+//   <ESC><o><n> strike ordering on or off (n=1 is on, n=0 is off); the letters of a line are struck in the
+//               order that turns the printwheel least rather than left to right (serial and parallel port only)
+//   <ESC><t><n> terminal mode (n=0 is off, n=1 is raw, n=2 is cooked). the keys typed on the Wheelwriter go
+//               to the host through serial 0, in raw mode as they're typed, in cooked mode a line at a time
+//               when Return is pressed (the erase key takes back the last character). the host's echo of
+//               the keys isn't printed again and the printed characters aren't echoed to the console.
+//   <ESC><i><n> IEEE 1284 reverse channel on the parallel port on or off (n=1 is on, n=0 is off). the host can
+//               negotiate nibble mode and read the status line (as for ENQ) or the device ID (see lpt1284.c).
+//               turn it on only with the IEEE 1284 lines wired.
+//   <ESC><k><n> the PS/2 keyboard's keys go to the host through serial 0 (n=1) or are printed (n=0). the
+//               grey and function keys are sent as VT220 escape sequences (see tty.c), the printed
+//               characters aren't echoed to the console. the Pause key switches between the two.
+//   <ESC><s>    spool the job: the characters printed from here to the end of the job (EOT, <ESC><c><n> or
+//               the job going idle) are also saved in flash (see spool.c), up to 2046 of them.
+//   <ESC><c><n> print n copies (n=1-9) of the spooled job. before each copy the printwheel spins and the
+//               printer waits for a key on the ps/2 keyboard (Esc cancels the copies left), or CR from the
+//               host (EOT cancels), while the paper is changed. nothing else prints until the copies are done.
+//   <ESC><F><n> define form n (n=1-9) in flash, replacing the old one, or erase all of the forms (n=0). one
+//               item follows on each line, "line,position:text" for fixed text or "line,position=k" for
+//               field k (1-9), at micro lines (1/96") and micro spaces (1/120") from the top left of the form.
+//               an empty line or EOT ends the definition (see forms.c).
+//   <ESC><f><n> fill in form n: the value of each field follows in turn, each ending with CR. after the
+//               last one (or EOT) the form prints from the line the paper is on, in the order that moves
+//               the paper and carrier least, and the carrier returns to the left margin on a new line.
 //
 // diagnostics/debugging:
+//   <ESC><^Z><b> print (on the serial console) execution times (PROFILE builds only, see bench.bat)
 //   <ESC><^Z><c> print (on the serial console) the current column
+//   <ESC><^Z><d> restore the default pitch, tab stops, auto linefeed and bit rate
 //   <ESC><^Z><r> reset the DS89C440 microcontroller
+//   <ESC><^Z><q> print (on the serial console) the status as key=value pairs, the same as ENQ (see task_status())
+//   <ESC><^Z><s> print (on the serial console) the performance counters as key=value pairs. from serial 0 it's
+//               taken out of the stream like ENQ and answered at once (see task_query())
+//   <ESC><^Z><t> print (on the serial console) the trace of recent bus words and events
 //   <ESC><^Z><u> print (on the serial console) the uptime as HH:MM:SS
 //   <ESC><^Z><v> print (on the serial console) variables
+//   <ESC><^Z><w> save the pitch, tab stops, auto linefeed, bit rate and printwheel in flash
 //   <ESC><^Z><e><n> turn flashing red error LED on or off (n=1 is on, n=0 is off)
 //   <ESC><^Z><p><n> print (on the serial console) the value of Port n (0-3) as 2 digit hex number
+//   <ESC><^Z><k><n> select 2400, 4800, 9600 or 19200 bps (n=0-3) for serial 0 after the next reset
 //-------------------------------------------------------------------------------------------
 void print_character(unsigned char charToPrint) {
-    static char escape = 0;                                 // escape sequence state
-    char c,i,t;
+    unsigned char c,i,t;                                    // (unsigned, column goes past 127 on a wide carriage)
+#ifdef PROFILE
+    unsigned char slot = escape ? PROF_ESCAPE : PROF_CHAR;
+
+    PROF_BEGIN(slot);
+#endif
+
+    trace_put(TR_CHAR|escape,charToPrint);
+    if (spool_recording)
+        spool_put(charToPrint);
 
     switch (escape) {
         case 0:
             switch (charToPrint) {
                 case NUL:
                     break;
+                case EOT:
+                    if (spool_recording) {                  // the end of the spooled job, not part of it
+                        spool_unput(1);
+                        spool_close();
+                    }
+                    job_end();                              // end of job, another source may print now
+#ifdef BUS_STUB
+                    stub_eot = TRUE;                        // the end of bench.txt (see stub_idle())
+#endif
+                    break;
                 case BEL:
                     ww_spin();
-                    putchar(BEL);
+                    echo(BEL);
                     break;
                 case BS:
                     if (column > 1){                        // only if there's at least one character on the line
                         ww_backspace();
                         --column;                           // update column
-                        putchar(BS);
+                        echo(BS);
                     }
                     break;
                 case HT:
@@ -380,12 +830,14 @@ void print_character(unsigned char charToPrint) {
                     ww_horizontal_tab(t);                   // move carrier to the next tab stop
                     for(i=0; i<t; i++){
                         ++column;                           // update column
-                        putchar(SP);
+                        echo(SP);
                     }
+                    if (!uSpaceCount)                       // the tab went past the right stop
+                        column = 1;
                     break;
                 case LF:
                     ww_linefeed();
-                    putchar(LF);
+                    echo(LF);
                     break;
                 case VT:
                     ww_linefeed();
@@ -394,18 +846,20 @@ void print_character(unsigned char charToPrint) {
                     ww_carriage_return();                   // return the carrier to the left margin
                     column = 1;                             // back to the left margin
                     attribute = 0;                          // cancel bold and underlining
-                    if (!switch1)                           // if switch 2 is on, automatically print linefeed
+                    if (AUTOLF)                             // if switch 1 is on, automatically print linefeed
                         ww_linefeed();
-                    putchar(CR);
+                    echo(CR);
                     break;
                 case ESC:
                     escape = 1;
                     break;
                 default:
                     if ((charToPrint > 0x1F) && (charToPrint < 0x80)) { // 'printable' characters 0x20-0x7F
-                        ww_print_letter(charToPrint,attribute);
-                        putchar(charToPrint);               // echo the character to the console
+                        ww_print_letter(charToPrint,(DRAFT ? attribute|0x08 : attribute)|(ORDER ? 0x10 : 0));
+                        echo(charToPrint);                  // echo the character to the console
                         ++column;                           // update column
+                        if (!uSpaceCount)                   // ww_print_letter() returned the carrier at the right stop
+                            column = 1;
                     }
             } // switch (charToPrint)
             break;  // case 0:
@@ -478,6 +932,44 @@ void print_character(unsigned char charToPrint) {
                     ww_micro_down();
                     escape = 0;
                     break;
+                case 'l':                                   // <ESC><l> auto linefeed on or off
+                    escape = 5;
+                    break;
+                case 'q':                                   // <ESC><q> draft printing on or off
+                    escape = 8;
+                    break;
+                case 'o':                                   // <ESC><o> strike ordering on or off
+                    escape = 9;
+                    break;
+                case 't':                                   // <ESC><t> terminal mode
+                    escape = 10;
+                    break;
+                case 'i':                                   // <ESC><i> IEEE 1284 reverse channel on or off
+                    escape = 11;
+                    break;
+                case 'k':                                   // <ESC><k> PS/2 keyboard to the host on or off
+                    escape = 12;
+                    break;
+                case 's':                                   // <ESC><s> spool the job
+                    if (!spoolCopies)                       // (not the spooled job itself)
+                        spool_start();
+                    escape = 0;
+                    break;
+                case 'F':                                   // <ESC><F> define a form
+                    form_define();
+                    escape = 14;
+                    break;
+                case 'f':                                   // <ESC><f> fill in a form
+                    form_fill();
+                    escape = 15;
+                    break;
+                case 'c':                                   // <ESC><c> copies of the spooled job
+                    if (spool_recording) {                  // the end of the spooled job, not part of it
+                        spool_unput(2);
+                        spool_close();
+                    }
+                    escape = 13;
+                    break;
                 case '\x1A':                                // <ESC><^Z> for remote diagnostics
                     escape = 2;
                     break;
@@ -485,6 +977,9 @@ void print_character(unsigned char charToPrint) {
                 case 'h':
                     printf(help1);                          // print the first half of the help
                     escape = 6;                             // wait for a key to be pressed...
+                    break;
+                default:                                    // not a command, ignore the sequence
+                    escape = 0;
             } // switch (charToPrint)
             break;  // case 1:
 
@@ -493,21 +988,59 @@ void print_character(unsigned char charToPrint) {
                 case 'A':
                 case 'a':
                     printf("\n%s\n",banner);
+                    escape = 0;
+                    break;
+#ifdef PROFILE
+                case 'B':
+                case 'b':                                   // <ESC><^Z><b> print execution times
+                    prof_dump();
+                    escape = 0;
+                    break;
+#endif
+                case 'D':
+                case 'd':                                   // <ESC><^Z><d> restore the default settings
+                    cfg_defaults();
+                    set_printwheel(printWheel);             // the pitch for the printwheel
+                    printf("\nDefault settings\n");
+                    for(c=1; c<column; c++) putchar(SP);    // return cursor to previous position on line
+                    escape = 0;
                     break;
                 case 'E':    
                 case 'e':                                   // <ESC><^Z><e> toggle red error LED
                     escape = 4;
                     break;
+                case 'K':
+                case 'k':                                   // <ESC><^Z><k> serial 0 bit rate
+                    escape = 7;
+                    break;
                 case 'P':
                 case 'p':                                   // <ESC><^Z><p> print port values
                     escape = 3;
                     break;
+                case 'Q':
+                case 'q':                                   // <ESC><^Z><q> print the status
+                    task_status();
+                    for(c=1; c<column; c++) putchar(SP);    // return cursor to previous position on line
+                    escape = 0;
+                    break;
                 case 'R':
                 case 'r':                                   // <ESC><^Z><r> system reset
                     TA = 0xAA;                                   // timed access
                     TA = 0x55;
                     FCNTL = 0x0F;                           // use the FCNTL register to preform a system reset
                     break;
+                case 'S':
+                case 's':                                   // <ESC><^Z><s> print the performance counters (from the parallel port, serial 0's are answered by task_query())
+                    stats_dump();
+                    for(c=1; c<column; c++) putchar(SP);    // return cursor to previous position on line
+                    escape = 0;
+                    break;
+                case 'T':
+                case 't':                                   // <ESC><^Z><t> print the trace ring
+                    trace_dump();
+                    for(c=1; c<column; c++) putchar(SP);    // return cursor to previous position on line
+                    escape = 0;
+                    break;
                 case 'U':
                 case 'u':                                   // <ESC><^Z><u> print uptime
                     printf("%s %02u%c%02u%c%02u\n","Uptime:",(int)hours,':',(int)minutes,':',(int)seconds);
@@ -526,9 +1059,24 @@ void print_character(unsigned char charToPrint) {
                     printf("%s %d\n",    "uLinesPerLine:  ",(int)uLinesPerLine);
                     printf("%s %d\n",    "uSpaceCount:    ",(int)uSpaceCount);
                     printf("%s %d\n",    "wdResets:       ",(int)wdResets);
+                    printf("%s %d\n",    "jobOwner:       ",(int)jobOwner);
+                    printf("%s 0x%02X\n","options:        ",(int)cfg.options);
+                    printf("%s %d\n",    "baud:           ",(int)cfg.baud);
+                    for(c=1; c<column; c++) putchar(SP);    // return cursor to previous position on line
+                    escape = 0;
+                    break;
+                case 'W':
+                case 'w':                                   // <ESC><^Z><w> save the settings in flash
+                    cfg.uSpacesPerChar = uSpacesPerChar;
+                    cfg.uLinesPerLine = uLinesPerLine;
+                    cfg.tabStop = tabStop;
+                    cfg.printWheel = printWheel;
+                    printf(cfg_save() ? "\nSettings saved\n" : "\nUnable to save settings\n");
                     for(c=1; c<column; c++) putchar(SP);    // return cursor to previous position on line
                     escape = 0;
                     break;
+                default:                                    // not a command, ignore the sequence
+                    escape = 0;
             } // switch (charToPrint)
             break;  // case 2:
 
@@ -550,6 +1098,8 @@ void print_character(unsigned char charToPrint) {
                     printf("%s 0x%02X\n","P3:",(int)P3);    // <ESC><^Z><p><3> print port 3 value
                     escape = 0;
                     break;
+                default:                                    // no such port, ignore the sequence
+                    escape = 0;
             } // switch (charToPrint)
             break;  // case 3:
 
@@ -564,18 +1114,105 @@ void print_character(unsigned char charToPrint) {
             escape = 0;
             break;  // case 4
 
+        case 5:
+            cfg.options &= ~CFG_LF_MASK;                    // <ESC><l><n> odd values turn auto linefeed on, even values turn it off
+            cfg.options |= (charToPrint & 0x01) ? CFG_LF_ON : CFG_LF_OFF;
+            escape = 0;
+            break;  // case 5
+
+        case 8:
+            if (charToPrint & 0x01)                         // <ESC><q><n> odd values select draft printing, even values quality
+                cfg.options |= CFG_DRAFT;
+            else
+                cfg.options &= ~CFG_DRAFT;
+            escape = 0;
+            break;  // case 8
+
+        case 9:
+            ww_flush();                                     // <ESC><o><n> strike what's held back before changing over
+            if (charToPrint & 0x01)                         // odd values turn strike ordering on, even values turn it off
+                cfg.options |= CFG_ORDER;
+            else
+                cfg.options &= ~CFG_ORDER;
+            escape = 0;
+            break;  // case 9
+
+        case 10:
+            cfg.options &= ~CFG_TTY_MASK;                   // <ESC><t><n> 0 turns terminal mode off, 1 selects raw, 2 cooked
+            if (charToPrint == '1')
+                cfg.options |= CFG_TTY_RAW;
+            else if (charToPrint == '2')
+                cfg.options |= CFG_TTY_COOKED;
+            tty_clear();
+            escape = 0;
+            break;  // case 10
+
+        case 11:
+            if (charToPrint & 0x01) {                       // <ESC><i><n> odd values turn the IEEE 1284 reverse channel on, even values turn it off
+                cfg.options |= CFG_1284;
+                lpt_init();                                 // take over the status lines
+            }
+            else
+                cfg.options &= ~CFG_1284;
+            escape = 0;
+            break;  // case 11
+
+        case 12:
+            if (charToPrint & 0x01)                         // <ESC><k><n> odd values send the PS/2 keyboard's keys to the host, even values print them
+                cfg.options |= CFG_KBHOST;
+            else
+                cfg.options &= ~CFG_KBHOST;
+            escape = 0;
+            break;  // case 12
+
+        case 13:
+            if ((charToPrint >= '1') && (charToPrint <= '9') && !spoolCopies) { // <ESC><c><n> print n copies of the spooled job
+                if (spool_length()) {
+                    spoolCopies = charToPrint-'0';
+                    spoolPos = 0;
+                    spool_pause();
+                }
+                else
+                    printf("\nNothing spooled\n");
+            }
+            escape = 0;
+            break;  // case 13
+
+        case 14:
+            if (!form_define_put(charToPrint)) {            // <ESC><F><n> the definition is over
+                if (charToPrint == EOT)
+                    job_end();
+                escape = 0;
+            }
+            break;  // case 14
+
+        case 15:
+            if (!form_fill_put(charToPrint)) {              // <ESC><f><n> the values are in
+                if (form_printing)
+                    sched_post(EV_FORM);
+                escape = 0;
+            }
+            break;  // case 15
+
         case 6:
             if (charToPrint == 0x20) {                      // if it's SPACE...
                 printf(help2);                              // print the second half of the help
                 escape = 0;
             }
-            else if (charToPrint == ESC) {                  // if it's ESCAPE, exit
+            else {                                          // ESCAPE (or anything else) exits
                putchar(0x0D);
                escape = 0;
             }
             break;
 
+        case 7:
+            if ((charToPrint >= '0') && (charToPrint <= '3'))
+                cfg.baud = charToPrint-'0';                 // <ESC><^Z><k><n> takes effect after saving and reset
+            escape = 0;
+            break;  // case 7
+
     } // switch (escape)
+    PROF_END(slot);
 }
 
 //-----------------------------------------------------------
@@ -593,7 +1230,9 @@ void print_character(unsigned char charToPrint) {
 // control up arrow  - micro paper up
 // control dn arrow  - micro paper down
 //
-// the Delete key acts as the Correction key (erases the last character)
+// the Delete key acts as the Correction key (erases the last character, bold and underlining
+// included, going back to earlier lines when there's nothing left on this one, as far back as
+// the correction memory reaches; see ww_erase_last())
 //
 // special characters on the Wheelwriter keyboard but not on the ps/2 keyboard:
 //  , , , , , , , , 
@@ -605,8 +1244,6 @@ void print_character(unsigned char charToPrint) {
 // release, margin setting and clearing, variable line spacing
 //-----------------------------------------------------------
 void handle_key(unsigned char key) {
-    static unsigned char __xdata keybuffer[64];                 // 64 character buffer used for ps/2 keyboard input
-    static unsigned char keybufptr = 0;                         // pointer into keybuffer
     unsigned char i,t;
 
     if (kb_ctrl_pressed()) {                                    // is the control key pressed?
@@ -648,9 +1285,8 @@ void handle_key(unsigned char key) {
     else switch (key) {                                         // check for "grey" (special) keys
         case PS2_KEY_KP_DELETE:                                 // delete erases last character
         case PS2_KEY_DELETE:
-            if (keybufptr){                                     // if there's at least one character on this line
-                ww_erase_letter(keybuffer[--keybufptr]);        // erase it
-                --column;                                       // update column
+            if (ww_erase_last()){                               // erase it, on this line or an earlier one
+                column = uSpaceCount/uSpacesPerChar+1;          // update column
                 putchar(BS);                                    // erase the last character on the Teraterm screen
                 putchar(SP);
                 putchar(BS);
@@ -662,87 +1298,355 @@ void handle_key(unsigned char key) {
             for(i=0; i<t; i++){
                 ++column;                                       // update column
                 putchar(SP);                                    // update serial console screen
-                keybuffer[keybufptr++ &0x3F] = SP;              // put spaces in the key buffer
             }
+            if (!uSpaceCount)                                   // the tab went past the right stop
+                column = 1;
             break;
         case PS2_KEY_BACKSPACE:
-            if (keybufptr) {
-                print_character(BS);                            // backspace
-                --keybufptr;
-            }
+            print_character(BS);                                // backspace, if there's at least one character on the line
             break;
         case PS2_KEY_KP_ENTER:
         case PS2_KEY_ENTER:
             print_character(CR);                                // carriage return
             print_character(LF);                                // line feed
-            keybufptr = 0;                                      // reset the pointer to the beginning
             break;
         case PS2_KEY_KP_LT_ARROW:
         case PS2_KEY_LT_ARROW:
-            if (keybufptr) {
-                print_character(BS);                            // backspace to move one position to the left
-                --keybufptr;
-            }
+            print_character(BS);                                // backspace to move one position to the left
             break;
         case PS2_KEY_RT_ARROW:
         case PS2_KEY_KP_RT_ARROW:
             print_character(SP);                                // space to move one position to the right
-            keybuffer[keybufptr++ &0x3F] = SP;
             break;
         case PS2_KEY_KP_UP_ARROW:                               // paper up
         case PS2_KEY_UP_ARROW:
             print_character(LF);                                // linefeed moves paper up
-            keybufptr = 0;
             break;
         case PS2_KEY_KP_DN_ARROW:                               // paper down
         case PS2_KEY_DN_ARROW:
             print_character(ESC);
             print_character(LF);                                // <ESC><LF> = reverse linefeed moves paper down
-            keybufptr = 0;
             break;
         case PS2_KEY_ESCAPE:
             print_character(ESC);
             break;
         case PS2_KEY_KP_DIV:
-            keybuffer[keybufptr++ &0x3F] = '/';
             print_character('/');
             break;
         case PS2_KEY_KP_MULT:
-            keybuffer[keybufptr++ &0x3F] = '*';
             print_character('*');
             break;
         case PS2_KEY_KP_MINUS:
-            keybuffer[keybufptr++ &0x3F] = '-';
             print_character('-');
             break;
         case PS2_KEY_KP_PLUS:
-            keybuffer[keybufptr++ &0x3F] = '+';
             print_character('+');
             break;
         default:
             if (key > 0x1F && key < 0x7F) {
-                keybuffer[keybufptr++ &0x3F] = key;             // save the key in case it needs to be erased later
                 print_character(key);                           // print the ASCII character
             }
     }  // else switch (key)
 }
 
+//-----------------------------------------------------------
+// the check byte of the journal: JOURNALKEY plus the sum of
+// the committed fields
+//-----------------------------------------------------------
+unsigned char jr_check(void) {
+    unsigned char i,sum;
+
+    sum = JOURNALKEY;
+    for (i=offsetof(journal_t,rxTail); i<offsetof(journal_t,check); i++)
+        sum += ((__xdata unsigned char *)&journal)[i];
+    return sum;
+}
+
+//-----------------------------------------------------------
+// record the job state in the journal after a character or
+// key has been completely handled. while strikes are held back
+// (draft underlining, strike ordering) the last commit is kept:
+// after a reset the carrier goes back to where it was and the
+// characters are printed again from the receive buffer. the
+// strikes are made first if that would leave too many behind.
+//-----------------------------------------------------------
+void jr_commit(void) {
+    if (ww_held()) {
+        if (uart_kept(journal.rxTail))
+            return;
+        ww_flush();
+    }
+    journal.rxTail = rx_tail;
+    journal.uSpaceCount = uSpaceCount;
+    journal.column = column;
+    journal.attribute = attribute;
+    journal.escape = escape;
+    journal.uSpacesPerChar = uSpacesPerChar;
+    journal.uLinesPerLine = uLinesPerLine;
+    journal.tabStop = tabStop;
+    journal.check = jr_check();
+    journal.key = JOURNALKEY;
+    journal.busy = 0;
+    journal.tries = 0;
+}
+
+//-----------------------------------------------------------
+// after a watchdog reset, carry on with the job from the state
+// in the journal. if the reset came in the middle of a character,
+// the Printer Board may have carried out some of its words (the
+// first strike of a bold letter and its one micro space advance,
+// say), so the carrier is no longer where the journal has it. it
+// is driven to the left margin by ww_carrier_home() and moved
+// back out to where the character should be printed. the
+// character is then printed again from the receive buffer (or
+// the parallel port, where the host holds it until it's
+// acknowledged).
+//-----------------------------------------------------------
+void jr_resume(void) {
+    unsigned int u;
+
+    uSpaceCount = journal.uSpaceCount;
+    column = journal.column;
+    attribute = journal.attribute;
+    escape = journal.escape;
+    uSpacesPerChar = journal.uSpacesPerChar;
+    uLinesPerLine = journal.uLinesPerLine;
+    tabStop = journal.tabStop;
+    if (escape >= 14)                                       // a form being defined or filled in can't be picked up again
+        escape = 0;
+    if (journal.busy) {
+        u = uSpaceCount;
+        ww_carrier_home();                                  // uSpaceCount = 0, wherever the carrier was
+        if (u)
+            ww_carrier_right(u);
+    }
+    if (journal.busy == EV_LPT) {
+        busyPin = HIGH;                                     // busy until the character has been printed again
+        sched_post(EV_LPT);
+    }
+    journal.busy = 0;
+    printf("Resuming at column %u\n",(int)column);
+}
+
+//-----------------------------------------------------------
+// a key from the ps/2 keyboard: typed on the Wheelwriter, or
+// sent to the host (see tty_host_key()). Pause switches from
+// one to the other.
+//-----------------------------------------------------------
+void keyboard_key(unsigned char key) {
+    if (key == PS2_KEY_PAUSE)
+        cfg.options ^= CFG_KBHOST;
+    else if (KBHOST)
+        tty_host_key(key);
+    else
+        handle_key(key);
+}
+
+//-----------------------------------------------------------
+// the key that ends the pause before a copy of the spooled job.
+// Esc cancels the copies left, any other key starts the next
+// copy at the left margin.
+//-----------------------------------------------------------
+void spool_key(unsigned char key) {
+    spoolPaused = FALSE;
+    if (key == PS2_KEY_ESCAPE) {
+        spoolCopies = 0;
+        printf("\nCopies cancelled\n");
+        job_end();
+        return;
+    }
+    escape = 0;                                             // each copy starts as the job did
+    attribute = 0;
+    if (column > 1) {
+        ww_carriage_return();
+        column = 1;
+    }
+    sched_post(EV_SPOOL);
+}
+
+//-----------------------------------------------------------
+// a character from the host while the copies are paused: CR
+// starts the next copy and EOT cancels the copies left, for a
+// printer with no ps/2 keyboard. returns FALSE for any other
+// character, which waits until the copies are done.
+//-----------------------------------------------------------
+__bit spool_host(unsigned char c) {
+    if (c == EOT)
+        spool_key(PS2_KEY_ESCAPE);
+    else if (c == CR)
+        spool_key(CR);
+    else
+        return FALSE;
+    return TRUE;
+}
+
+//-----------------------------------------------------------
+// tasks run by the main loop when their event is posted. each
+// runs to completion, handling at most its budget of items.
+//-----------------------------------------------------------
+
+// keys from the ps/2 keyboard
+void task_keyboard(void) {
+    unsigned char n,key;
+
+    for (n=0; n<KEY_BUDGET; n++) {
+        if (!kb_scancode_avail() || (!KBHOST && !spoolPaused && !job_claim(SRC_KEY)))  // nothing to do, or another source owns the job
+            return;                                         // (keys going to the host print nothing, they needn't wait)
+        key = kb_decode_scancode(kb_get_scancode());        // decode the scancode from the keyboard
+        if (key && spoolPaused) {                           // the operator has changed the paper for the next copy
+            spool_key(key);
+            continue;
+        }
+        if (key) {
+            ++stats.keys;
+            trace_put(TR_KEY,key);
+            journal.busy = EV_KEY;
+            keyboard_key(key);
+            jr_commit();
+        }
+    }
+    if (kb_scancode_avail())
+        sched_defer(EV_KEY);                                // more to do, after the events of higher priority
+}
+
+// words from the Wheelwriter BUS
+void task_bus(void) {
+    unsigned char n;
+
+    PROF_BUS_TASK();
+    for (n=0; n<BUS_BUDGET; n++) {
+        if (!ww_data_avail())
+            return;
+        parseWWdata(ww_get_data());                         // echo Wheelwriter keys to the console serial port
+    }
+    if (ww_data_avail())
+        sched_defer(EV_BUS);
+}
+
+// characters from serial 0
+void task_serial(void) {
+    unsigned char n,c;
+
+    for (n=0; n<SERIAL_BUDGET; n++) {
+        if (spoolPaused && uart_char_avail() && spool_host(uart_peek())) {
+            uart_getchar();                                 // the host's answer to the pause before a copy
+            continue;
+        }
+        if (!uart_char_avail() || (TTY && ttyTimer) || !job_claim(SRC_SERIAL))
+            return;                                         // (in terminal mode, wait while the Wheelwriter's keyboard is in use)
+        journal.busy = EV_SERIAL;
+        c = uart_getchar();                                 // retrieve it...
+        if (!(TTY && tty_echo(c)))                          // ...and unless it's the host's echo of a key typed on the Wheelwriter...
+            print_character(c);                             // ...make the Wheelwriter print it
+        jr_commit();
+    }
+    if (uart_char_avail())
+        sched_defer(EV_SERIAL);
+}
+
+// a character from the parallel port. the host sends the next one after the acknowledge.
+void task_lpt(void) {
+    if (!busyPin)
+        return;
+    if (spoolPaused && spool_host(P2))                      // the host's answer to the pause before a copy
+        ;
+    else if (job_claim(SRC_LPT)) {
+        ++stats.lptBytes;
+        journal.busy = EV_LPT;
+        print_character(P2);                                // print the character from the parallel port (port 2)
+        jr_commit();
+    }
+    else
+        return;
+    ackPin = LOW;                                           // set Acknowledge pin low
+    NOP();                                                  // 3 microseconds delay...
+    NOP();
+    NOP();
+    ackPin = HIGH;                                          // set Acknowledge pin high
+    busyPin = LOW;                                          // set Busy pin low, ready for next character
+}
+
+// characters of the spooled job, copy after copy (see <ESC><c><n>), from the flash
+void task_spool(void) {
+    unsigned char n;
+
+    for (n=0; n<SPOOL_BUDGET; n++) {
+        if (!spoolCopies || spoolPaused || form_printing)   // (a form filled in by the job is printed first, see task_form())
+            return;
+        if (spoolPos == spool_length()) {                   // the end of a copy
+            spoolPos = 0;
+            if (--spoolCopies)
+                spool_pause();
+            else
+                job_end();                                  // the last one, the other sources may print again
+            continue;
+        }
+        jobTimer = JOB_IDLE;                                // the job carries on
+        journal.busy = EV_SPOOL;
+        print_character(spool_read(spoolPos++));
+        jr_commit();
+    }
+    sched_defer(EV_SPOOL);
+}
+
+// characters of the form being printed (see <ESC><f><n>), from the flash
+void task_form(void) {
+    unsigned char n,c;
+
+    for (n=0; n<FORM_BUDGET; n++) {
+        if (!form_printing)
+            return;
+        jobTimer = JOB_IDLE;                                // the job carries on
+        c = form_get();                                     // (the carrier and paper are moved to it)
+        if (!c) {                                           // the whole form has been printed, a new line for what follows
+            ww_carriage_return();
+            ww_linefeed();
+            column = 1;
+            echo(CR);
+            echo(LF);
+            if (spoolCopies)
+                sched_post(EV_SPOOL);                       // the rest of the spooled job
+            else
+                job_end();
+            return;
+        }
+        ww_print_letter(c,(DRAFT ? attribute|0x08 : attribute)|(ORDER ? 0x10 : 0));
+        echo(c);
+        ++column;
+    }
+    sched_defer(EV_FORM);
+}
+
 //-----------------------------------------------------------
 // main(void)
 //-----------------------------------------------------------
 void main(void){
-   unsigned int loopcounter = 0;
    unsigned int scancode, WWdata;
    unsigned char state = 0;
    unsigned char lastsec = 0;
+   unsigned char saved,resume,abandon;
 
    wd_disable_watchdog();                                   // disable wwtchdog timer reset
 
    PMR |= 0x01;                                             // enable internal SRAM MOVX memory
+   trace_init();                                            // keep the trace from before the reset if it's valid
+   stats_init();                                            // clear the performance counters, start timer 2
+   saved = cfg_load();                                      // settings saved in flash, or the defaults
+   resume = ((WDCON & 0x44) == 0x04) &&                     // watchdog reset with a good journal?
+            (journal.key == JOURNALKEY) && (journal.check == jr_check());
+   abandon = resume && (++journal.tries > JOURNALTRIES);    // the same character has reset us too many times?
+   if (abandon) {
+      resume = FALSE;
+      journal.key = 0;                                      // give up on the job
+   }
+#ifdef PROFILE
+   prof_init();                                             // clear the execution times
+#endif
 
    busyPin = LOW;                                           // set LPT Busy low: ready to receive
    ackPin = HIGH;                                           // set LPT Acknowledge high
    P2 = 0xFF;                                               // set all pins of port 2 high to act as input
+   lpt_init();                                              // the IEEE 1284 status lines for compatibility mode
 
    IT0 = 1;                                                 // configure interrupt 0 for falling edge on INT0 (P3.2)
    EX0 = 1;                                                 // enable EX0 Interrupt
@@ -754,6 +1658,9 @@ void main(void){
 
    kb_init();                                               // initialize ps/2 keyboard
    uart_init();                                             // initialize serial 0 for N-8-1 at 9600bps, RTS-CTS handshaking
+   uart_baud(cfg.baud);                                     // at the saved bit rate
+   if (resume)
+      uart_resume(journal.rxHead,journal.rxTail);           // keep the characters not yet printed
    ww_init();                                               // initialize serial 1 for the Wheelwriter
 
    EA = TRUE;                                               // global interrupt enable
@@ -763,18 +1670,33 @@ void main(void){
    switch (WDCON & 0x44) {
       case 0x00:
          printf("External reset\n\n");
+         set_printwheel(printWheel);                       // printWheel survives the reset, the pitch doesn't
+         journal.key = 0;                                  // start over
          break;
       case 0x04:
-         printf("%s %u\n\n","Watchdog resets:",(int)++wdResets);
+         printf("%s %u\n","Watchdog resets:",(int)++wdResets);
+         if (abandon)
+            printf("Job abandoned\n");
+         trace_dump();                                     // show what was happening before the reset
+         printf("\n");
+         if (!resume)
+            set_printwheel(printWheel);
          break;
       case 0x40:
          printf("Power on reset\n\n");
+         wdResets = 0;
+         journal.key = 0;                                  // journal contents are random after power on
+         trace_clear();                                    // trace contents are random after power on
+         if (saved && KNOWN_PRINTWHEEL(cfg.lastWheel)) {   // printwheel cached in flash by the last run...
+            set_printwheel(cfg.lastWheel);                 // ready at once, parseWWdata() checks it when the Function Board asks
+            wheelTimer = ONESEC*6;                         // but nothing prints until it has, the boards are busy starting up
+            break;
+         }
          printf("Initializing");
          lastsec = seconds;
 		   timeout = ONESEC*6;										  // 6 seconds for wheelwriter to initialize
-         wdResets = 0;
          printWheel = 0;
-         while (!printWheel) {                             // waiting for printwheel code...
+         while (!printWheel && timeout) {                  // waiting for printwheel code...
             if (lastsec != seconds) {                      // once each second...
                lastsec = seconds;
                putchar('.');                               // dots on screen to monitor progress   
@@ -794,44 +1716,7 @@ void main(void){
                         state = 0;
                      break;
                   case 2:
-                     printWheel = WWdata;
-                     switch (printWheel) {
-                        case 0x008:
-                           uSpacesPerChar = 10;
-                           uLinesPerLine = 16;
-                           tabStop = 6;                    // tab stops every 6 characters (every 1/2 inch)
-                           printf("\nPS printwheel\n");
-                           break;
-                        case 0x010:
-                           uSpacesPerChar = 8;
-                           uLinesPerLine = 12;
-                           tabStop = 7;                    // tab stops every 7 characters (every 1/2 inch)
-                           printf("\n15P printwheel\n");
-                           break;
-                        case 0x020:
-                           uSpacesPerChar = 10;
-                           uLinesPerLine = 16;
-                           tabStop = 6;                    // tab stops every 6 characters (every 1/2 inch)
-                           printf("\n12P printwheel\n");
-                           break;
-                        case 0x021:
-                           uSpacesPerChar = 10;
-                           uLinesPerLine = 16;
-                           tabStop = 6;                    // tab stops every 6 characters (every 1/2 inch)
-                           printf("\nNo printwheel\n");
-                           break;
-                        case 0x040:
-                           uSpacesPerChar = 12;
-                           uLinesPerLine = 16;
-                           tabStop = 5;                    // tab stops every 5 characters (every 1/2 inch)
-                           printf("\n10P printwheel\n");
-                           break;
-                        default:
-                           uSpacesPerChar = 10;
-                           uLinesPerLine = 16;
-                           tabStop = 6;                    // tab stops every 6 characters (every 1/2 inch)
-                           printf("\nUnable to determine printwheel. Assuming 12P.\n");
-                     } //switch (printWheel)
+                     check_printwheel(WWdata);
                } // switch (state)
             } // if (ww_data_avail())
          } // while (!printWheel)
@@ -840,6 +1725,16 @@ void main(void){
 						printf("\nWheelwriter timed out\n");
 				 }
    } // switch (WDCON & 0x44)
+
+   if (saved && (cfg.printWheel == printWheel))            // settings saved with this printwheel installed?
+      apply_settings();                                    // use the saved pitch and tab stops
+
+   wd_clr_flags();                                         // clear watchdog reset and POR flags for next start up
+   wd_init_watchdog(3);                                    // WD interval = (1/12MHz)*2^26 = 5592.4 milliseconds
+   if (resume) {
+      jr_resume();                                         // carry on with the job interrupted by the watchdog, guarded by the watchdog
+      wd_reset_watchdog();
+   }
 	 
    while (ww_data_avail()) {                           		// absorb any remaining data from the Wheelwriter...
       ww_get_data();
@@ -864,9 +1759,6 @@ void main(void){
       printf("PS/2 keyboard detected\n");
    }
 
-   wd_clr_flags();                                         // clear watchdog reset and POR flags for next start up
-   wd_init_watchdog(3);                                    // WD interval = (1/12MHz)*2^26 = 5592.4 milliseconds
-
    initializing = FALSE;
    amberLED = OFF;                                         // turn off the amber LED
    greenLED = OFF;                                         // turn off the green LED
@@ -878,29 +1770,48 @@ void main(void){
    //----------------- loop here forever -----------------------------------------
    while(TRUE) {
 
-      wd_reset_watchdog();                                // "pet" the watchdog every time through the loop
-
-      if (++loopcounter==0)                               // every 65536 times through the loop (at about 2Hz)
-         greenLED = !greenLED;                            // toggle the green LED
+      wd_reset_watchdog();                                // "pet" the watchdog before each task
 
-      if (uart_char_avail())                          	 // if there is a character in the serial 0 receive buffer...
-         print_character(uart_getchar());          		 // retrieve it and make the Wheelwriter print it
+      if (lpt_active)                                     // the host is negotiating the IEEE 1284 reverse channel (see lpt_poll())
+         task_1284();
 
-      if (busyPin) {                                  	 // if there is a character from the parallel port...
-         print_character(P2);                      		 // print the character from the parallel port (port 2)
-         ackPin = LOW;                             		 // set Acknowledge pin low
-         NOP();                                  			 // 3 microseconds delay...
-         NOP();
-         NOP();
-         ackPin = HIGH;                            		 // set Acknowledge pin high
-         busyPin = LOW;                            		 // set Busy pin low, ready for next character
+      switch (sched_next()) {                             // run the task for the highest priority event
+         case EV_STATUS:
+            task_query();
+            break;
+         case EV_KEY:
+            task_keyboard();
+            break;
+         case EV_BUS:
+            task_bus();
+            break;
+         case EV_SERIAL:
+            task_serial();
+            break;
+         case EV_LPT:
+            task_lpt();
+            break;
+         case EV_SPOOL:
+            task_spool();
+            break;
+         case EV_FORM:
+            task_form();
+            break;
+         default:                                         // nothing to do...
+            if (wheelFlush) {                             // the printwheel exchange on the BUS is over
+               wheelFlush = FALSE;
+               ww_flush();
+            }
+            if (ww_held() && (jobTimer <= JOB_IDLE-HELD_IDLE))  // the source has run dry, strike what's held back (draft, strike ordering)
+               ww_flush();                                // rather than wait for the job to end
+            if (!jobTimer)                                // the job is over, end the spooled job with it
+               spool_close();
+            flash_flush();                                // program what's been collected for the flash while nothing's going on
+#ifdef BUS_STUB
+            stub_idle();                                  // the end of the run in the simulator (see stub.c)
+#endif
+            sched_idle();                                 // sleep until the next interrupt
       }
-
-      if (kb_scancode_avail())                        	 // if there is a scancode from the ps/2 keyboard...
-         handle_key(kb_decode_scancode(kb_get_scancode()));// decode the scancode from the keyboard
-
-      if (ww_data_avail())                            	 // if there's data from the Wheelwriter...
-         parseWWdata(ww_get_data());               		 // echo Wheelwriter keys to the console serial port
    }
 }
 
@@ -916,5 +1827,9 @@ char _getkey(void) {
 
 // for printf
 int putchar(int c)  {
+   if (lpt_reverse) {                                      // answering the host over the parallel port
+      lpt_put(c);
+      return c;
+   }
    return uart_putchar(c);
 }
\ No newline at end of file
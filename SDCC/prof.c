@@ -0,0 +1,62 @@
+//  Execution time profiling
+//  for the Small Device C Compiler (SDCC)
+
+#include <stdio.h>
+#include "hal.h"
+#include "prof.h"
+
+#ifdef PROFILE
+
+__xdata volatile unsigned int  prof_start[PROF_SLOTS];      // timer 2 at the start of the operation
+__xdata volatile unsigned int  prof_elapsed[PROF_SLOTS];    // microseconds taken by the last operation
+__xdata volatile unsigned int  prof_worst[PROF_SLOTS];      // worst case microseconds
+__xdata volatile unsigned int  prof_count[PROF_SLOTS];      // number of operations timed
+__xdata volatile unsigned long prof_total[PROF_SLOTS];      // total microseconds
+volatile __bit prof_asleep;                                 // sched_idle() has the MCU in idle mode
+volatile __bit prof_woken;                                  // a word from the BUS ended idle, task_bus() hasn't taken it up yet
+
+__code char * __code prof_names[PROF_SLOTS] = {
+    "character ",
+    "escape    ",
+    "bus word  ",
+    "uart0_isr ",
+    "uart1_isr ",
+    "kb_isr    ",
+    "timer0_isr",
+    "t0 latency",
+    "t0 wake   ",
+    "bus wake  "
+};
+
+//-----------------------------------------------------------
+// clear the counts. timer 2 is already running, see stats_init().
+//-----------------------------------------------------------
+void prof_init(void) {
+    unsigned char i;
+
+    for (i=0; i<PROF_SLOTS; i++) {
+        prof_worst[i] = 0;
+        prof_count[i] = 0;
+        prof_total[i] = 0;
+    }
+}
+
+//-----------------------------------------------------------
+// print the count, average and worst case time for each
+// operation, in microseconds and in clocks at 12 MHz (one
+// clock per machine cycle on the DS89C440), then start over.
+//-----------------------------------------------------------
+void prof_dump(void) {
+    unsigned char i;
+    unsigned long avg;
+
+    printf("\n%s\n","operation   count   avg us  worst us  avg clk worst clk");
+    for (i=0; i<PROF_SLOTS; i++) {
+        avg = prof_count[i] ? prof_total[i]/prof_count[i] : 0UL;
+        printf("%s %6u %8lu %9u %8lu %9lu\n",prof_names[i],prof_count[i],
+               avg,prof_worst[i],avg*12,prof_worst[i]*12UL);
+    }
+    prof_init();
+}
+
+#endif
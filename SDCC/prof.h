@@ -0,0 +1,114 @@
+//  Execution time profiling
+//  for the Small Device C Compiler (SDCC)
+//
+//  Compiled in only when PROFILE is defined (see bench.bat). Timer 2, started by stats_init(),
+//  runs free at OSC/12, so each count is 1 microsecond (12 clocks on the DS89C440's one clock
+//  per cycle core).
+//
+//  PROF_T0_LATENCY is not an execution time but how long the timer 0 interrupt waited to be
+//  served: timer 0 keeps counting after it overflows, so on entry to timer0_isr() it holds the
+//  microseconds since its interrupt was raised. The worst case is the longest any interrupt of
+//  the same priority can be held off by the others.
+//
+//  The wake-up from idle mode (see sched_idle()) is timed in two parts. PROF_T0_WAKE is the
+//  timer 0 latency when its interrupt is the one that ended idle: the time the core takes to
+//  wake and reach an ISR, the same for any interrupt. PROF_BUS_WAKE starts when uart1_isr() is
+//  entered for a word that ended idle and stops when task_bus() takes it up: the rest of the
+//  way from the BUS to the task. A word's arrival is therefore its wake-up plus its bus wake.
+
+#ifndef __PROF_H__
+#define __PROF_H__
+
+#define PROF_CHAR        0                                  // print_character() outside an escape sequence
+#define PROF_ESCAPE      1                                  // print_character() within an escape sequence
+#define PROF_BUSWORD     2                                  // ww_put_data(), one word sent and acknowledged
+#define PROF_UART0_ISR   3                                  // uart0_isr()
+#define PROF_UART1_ISR   4                                  // uart1_isr()
+#define PROF_KB_ISR      5                                  // kb_isr()
+#define PROF_TIMER0_ISR  6                                  // timer0_isr()
+#define PROF_T0_LATENCY  7                                  // timer 0 overflow to timer0_isr()
+#define PROF_T0_WAKE     8                                  // timer 0 overflow to timer0_isr(), waking from idle
+#define PROF_BUS_WAKE    9                                  // uart1_isr() to task_bus(), for a word that woke the MCU
+#define PROF_SLOTS       10
+
+#ifdef PROFILE
+
+extern __xdata volatile unsigned int  prof_start[PROF_SLOTS];
+extern __xdata volatile unsigned int  prof_elapsed[PROF_SLOTS];
+extern __xdata volatile unsigned int  prof_worst[PROF_SLOTS];
+extern __xdata volatile unsigned int  prof_count[PROF_SLOTS];
+extern __xdata volatile unsigned long prof_total[PROF_SLOTS];
+extern volatile __bit prof_asleep;
+extern volatile __bit prof_woken;
+
+#define PROF_READ(v) HAL_TIMER2_READ(v)
+
+// these are macros rather than functions so that they can be used inside the ISRs
+#define PROF_BEGIN(n) PROF_READ(prof_start[n])
+
+#define PROF_END(n) {                                       \
+    PROF_READ(prof_elapsed[n]);                             \
+    prof_elapsed[n] -= prof_start[n];                       \
+    PROF_RECORD(n);                                         \
+}
+
+// the microseconds since timer 0 overflowed, read the way HAL_TIMER2_READ() reads timer 2
+#define PROF_T0(n) {                                        \
+    prof_elapsed[n] = TH0;                                  \
+    prof_elapsed[n] = (prof_elapsed[n] << 8) | TL0;         \
+    if ((unsigned char)(prof_elapsed[n] >> 8) != TH0)       \
+        prof_elapsed[n] = ((unsigned int)TH0 << 8) | TL0;   \
+    PROF_RECORD(n);                                         \
+}
+
+#define PROF_LATENCY() {                                    \
+    if (prof_asleep)                                        \
+        PROF_T0(PROF_T0_WAKE)                               \
+    else                                                    \
+        PROF_T0(PROF_T0_LATENCY)                            \
+}
+
+// sched_idle() sets prof_asleep just before idle mode and clears it with the first instruction
+// after, so it's only seen set by the ISR that ended idle
+#define PROF_SLEEP() prof_asleep = 1
+#define PROF_AWAKE() prof_asleep = 0
+
+// in uart1_isr(), after PROF_BEGIN(PROF_UART1_ISR): a word that ended idle starts the bus wake
+#define PROF_BUS_WOKE() {                                   \
+    if (prof_asleep) {                                      \
+        prof_start[PROF_BUS_WAKE] = prof_start[PROF_UART1_ISR]; \
+        prof_woken = 1;                                     \
+    }                                                       \
+}
+
+// in task_bus(): the word that ended idle is taken up
+#define PROF_BUS_TASK() {                                   \
+    if (prof_woken) {                                       \
+        prof_woken = 0;                                     \
+        PROF_END(PROF_BUS_WAKE);                            \
+    }                                                       \
+}
+
+#define PROF_RECORD(n) {                                    \
+    if (prof_elapsed[n] > prof_worst[n])                    \
+        prof_worst[n] = prof_elapsed[n];                    \
+    prof_total[n] += prof_elapsed[n];                       \
+    ++prof_count[n];                                        \
+}
+
+void prof_init(void);
+void prof_dump(void);
+
+#else
+
+#define PROF_BEGIN(n)
+#define PROF_END(n)
+#define PROF_LATENCY()
+#define PROF_SLEEP()
+#define PROF_AWAKE()
+#define PROF_BUS_WOKE()
+#define PROF_BUS_TASK()
+
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+//  Cooperative scheduler
+//  for the Small Device C Compiler (SDCC)
+//
+//  The ISRs post events; main() asks for the highest priority pending event and runs the
+//  task for it to completion. A task that still has work left when its budget is used up
+//  defers its event, which then waits for the events of higher priority. A stream of fresh
+//  events can't hold it back, as it could if it waited for there to be none.
+//  With nothing to do the MCU waits in idle mode for the next interrupt.
+
+#include "hal.h"
+#include "sched.h"
+#include "prof.h"
+
+volatile __data unsigned char sched_events;                 // events posted and not yet run
+__data unsigned char sched_deferred;                        // events deferred by tasks that used up their budget
+
+//-----------------------------------------------------------
+// returns the highest priority pending event, fresh or deferred,
+// and clears it. a deferred event ranks below the fresh ones of
+// higher priority only. returns zero if there is nothing to do.
+//-----------------------------------------------------------
+unsigned char sched_next(void) {
+    unsigned char ev;
+
+    ev = sched_events | sched_deferred;
+    ev &= 0-ev;                                             // lowest set bit is the highest priority
+    sched_events &= ~ev;
+    sched_deferred &= ~ev;
+    return ev;
+}
+
+//-----------------------------------------------------------
+// run the task for 'ev' again once the pending events of
+// higher priority have been serviced.
+//-----------------------------------------------------------
+void sched_defer(unsigned char ev) {
+    sched_deferred |= ev;
+}
+
+//-----------------------------------------------------------
+// stop the CPU in idle mode until the next interrupt (serial 0,
+// serial 1, INT0, INT1 or the 50 millisecond timer 0 tick) if
+// no event is pending. the timers, UARTs and watchdog keep running.
+//
+// interrupts are disabled while checking for events so an event
+// posted just after the check can't be slept through: the 8051
+// always executes one more instruction after the one that sets
+// EA before it services an interrupt, so the MCU enters idle and
+// a pending interrupt ends it at once. leaving idle costs no more
+// than the normal interrupt latency: the ISR runs immediately and
+// the main loop continues when it returns. a PROFILE build times
+// the wake-up (see prof.h).
+//-----------------------------------------------------------
+void sched_idle(void) {
+    EA = 0;
+    if (!sched_events && !sched_deferred) {
+        PROF_SLEEP();
+        EA = 1;
+        PCON |= 0x01;                                       // IDL bit, enter idle mode
+        PROF_AWAKE();                                       // (the ISR that ended idle has run)
+    }
+    EA = 1;
+}
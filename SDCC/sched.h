@@ -0,0 +1,25 @@
+//  Cooperative scheduler
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+// events, in priority order (bit 0 is the highest priority)
+#define EV_STATUS  0x01                                     // ENQ from serial 0, the host asks for the status (answered first, the host is waiting)
+#define EV_KEY     0x02                                     // scancode from the ps/2 keyboard
+#define EV_BUS     0x04                                     // word from the Wheelwriter BUS
+#define EV_SERIAL  0x08                                     // character from serial 0
+#define EV_LPT     0x10                                     // character from the parallel port
+#define EV_SPOOL   0x20                                     // copies of the spooled job to print (see task_spool())
+#define EV_FORM    0x40                                     // a form filled in and ready to print (see task_form())
+
+extern volatile __data unsigned char sched_events;
+
+// post an event. a single ORL instruction, so safe from the ISRs and from main
+#define sched_post(ev) sched_events |= (ev)
+
+unsigned char sched_next(void);
+void sched_defer(unsigned char ev);
+void sched_idle(void);
+
+#endif
@@ -0,0 +1,91 @@
+//  Job spool in flash
+//  for the Small Device C Compiler (SDCC)
+//
+//  <ESC><s> starts recording the characters of a job, as they're printed, into a reserved
+//  part of the flash; EOT (or the job going idle) ends it. <ESC><c><n> then prints the job
+//  again n times from the flash (see task_spool() in main.c), so the host sends a form once
+//  however many copies are wanted. There's no room for a spool in the MOVX SRAM.
+//
+//  The characters go to the flash a batch at a time and each page is erased when recording
+//  reaches it, both in a quiet moment on the buses (see flash.c). The length is written when
+//  recording ends, so a spool cut short by a reset reads back as empty.
+
+#include "hal.h"
+#include "flash.h"
+#include "spool.h"
+
+#define FALSE 0
+#define TRUE  1
+
+__bit spool_recording = FALSE;                              // the characters printed go into the spool
+unsigned int spoolLength;                                   // characters recorded so far
+
+//-----------------------------------------------------------
+// start recording. the first page, which has the length, is
+// erased now and the others as the job reaches them.
+//-----------------------------------------------------------
+void spool_start(void) {
+    flash_erase(SPOOL_BASE);
+    spoolLength = 0;
+    spool_recording = TRUE;
+}
+
+//-----------------------------------------------------------
+// record a character. a job too big for the spool isn't kept.
+//-----------------------------------------------------------
+void spool_put(unsigned char c) {
+    unsigned int a;
+
+    if (!spool_recording)
+        return;
+    if (spoolLength == SPOOL_SIZE) {
+        spool_recording = FALSE;
+        flash_put(SPOOL_BASE,0x00);                         // length 0, nothing spooled
+        flash_put(SPOOL_BASE+1,0x00);
+        flash_flush();
+        return;
+    }
+    a = SPOOL_BASE+2+spoolLength;
+    if (!(a & (SPOOL_PAGESIZE-1)))                          // the first character in the page
+        flash_erase(a);
+    flash_put(a,c);
+    ++spoolLength;
+}
+
+//-----------------------------------------------------------
+// take back the last 'n' characters recorded (the start of a
+// command that turns out to be for the spool itself)
+//-----------------------------------------------------------
+void spool_unput(unsigned char n) {
+    spoolLength = (n < spoolLength) ? spoolLength-n : 0;
+}
+
+//-----------------------------------------------------------
+// stop recording and write the length
+//-----------------------------------------------------------
+void spool_close(void) {
+    if (!spool_recording)
+        return;
+    spool_recording = FALSE;
+    flash_put(SPOOL_BASE,spoolLength >> 8);
+    flash_put(SPOOL_BASE+1,spoolLength & 0xFF);
+    flash_flush();
+}
+
+//-----------------------------------------------------------
+// returns the length of the spooled job, 0 if there's none
+// (or it's still being recorded)
+//-----------------------------------------------------------
+unsigned int spool_length(void) {
+    unsigned int n;
+
+    if (spool_recording)
+        return 0;
+    n = ((unsigned int)HAL_FLASH_READ(SPOOL_BASE) << 8) | HAL_FLASH_READ(SPOOL_BASE+1);
+    return (n > SPOOL_SIZE) ? 0 : n;                        // erased (0xFFFF) is empty
+}
+
+// returns character 'pos' of the spooled job
+unsigned char spool_read(unsigned int pos) {
+    return HAL_FLASH_READ(SPOOL_BASE+2+pos);
+}
@@ -0,0 +1,23 @@
+//  Job spool in flash
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __SPOOL_H__
+#define __SPOOL_H__
+
+// the 2K at the bottom of the upper 16K of the flash, above the code and the configuration page
+// (see config.h), holds the spooled job: two bytes of length, high byte first, then the characters.
+#define SPOOL_BASE     0x4000
+#define SPOOL_PAGES    4
+#define SPOOL_PAGESIZE 512
+#define SPOOL_SIZE     (SPOOL_PAGES*SPOOL_PAGESIZE-2)       // characters the spool holds
+
+extern __bit spool_recording;
+
+void spool_start(void);
+void spool_put(unsigned char c);
+void spool_unput(unsigned char n);
+void spool_close(void);
+unsigned int spool_length(void);
+unsigned char spool_read(unsigned int pos);
+
+#endif
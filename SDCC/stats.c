@@ -0,0 +1,85 @@
+//  Runtime performance counters
+//  for the Small Device C Compiler (SDCC)
+//
+//  <ESC><^Z><s> reports the counters on one line of key=value pairs for monitoring software.
+//  The counters are cleared at reset; take the difference between two reports for rates.
+
+#include <stdio.h>
+#include "hal.h"
+#include "stats.h"
+
+extern volatile unsigned char hours;                        // uptime, defined in main.c
+extern volatile unsigned char minutes;
+extern volatile unsigned char seconds;
+
+__xdata volatile stats_t stats;
+
+//-----------------------------------------------------------
+// clear the counters and start timer 2 as a free running 16 bit
+// timer clocked at OSC/12 (1 microsecond) for timing the bus
+//-----------------------------------------------------------
+void stats_init(void) {
+    unsigned char i;
+
+    for (i=0; i<sizeof(stats_t); i++)
+        ((__xdata unsigned char *)&stats)[i] = 0;
+    T2CON = 0x00;                                           // 16 bit auto-reload timer, no external control
+    RCAP2H = 0;                                             // reload from zero
+    RCAP2L = 0;
+    TH2 = 0;
+    TL2 = 0;
+    TR2 = 1;                                                // run timer 2
+}
+
+//-----------------------------------------------------------
+// add 'us' microseconds to the time spent waiting on the bus.
+// no division, it's called for every word sent.
+//-----------------------------------------------------------
+void stats_blocked(unsigned int us) {
+    while (us >= 1000) {
+        us -= 1000;
+        ++stats.blockedMs;
+    }
+    stats.blockedUs += us;
+    if (stats.blockedUs >= 1000) {
+        stats.blockedUs -= 1000;
+        ++stats.blockedMs;
+    }
+}
+
+// read a counter that an interrupt updates. the 8051 reads it a byte at a time,
+// so the interrupt must not change it half way through.
+static unsigned long stats_long(__xdata volatile unsigned long *p) {
+    unsigned long v;
+
+    __critical {
+        v = *p;
+    }
+    return v;
+}
+
+static unsigned int stats_int(__xdata volatile unsigned int *p) {
+    unsigned int v;
+
+    __critical {
+        v = *p;
+    }
+    return v;
+}
+
+//-----------------------------------------------------------
+// print the counters as one line of key=value pairs
+//-----------------------------------------------------------
+void stats_dump(void) {
+    unsigned long uptime;
+
+    __critical {                                            // timer0_isr() may carry the seconds into the minutes
+        uptime = ((unsigned long)hours*60+minutes)*60+seconds;
+    }
+    printf("\nSTATS serial=%lu lpt=%lu keys=%lu glyphs=%lu words=%lu carrier=%lu paper=%lu",
+           stats_long(&stats.serialBytes),stats.lptBytes,stats.keys,stats.glyphs,stats.busWords,
+           stats.carrierMoves,stats.paperMoves);
+    printf(" pauses=%u serialhw=%u bushw=%u busoverruns=%u kboverruns=%u acklate=%u blockedms=%lu uptime=%lu\n",
+           stats_int(&stats.rtsPauses),(int)stats.serialHighWater,(int)stats.busHighWater,stats_int(&stats.busOverruns),
+           stats_int(&stats.kbOverruns),stats.ackLate,stats.blockedMs,uptime);
+}
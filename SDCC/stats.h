@@ -0,0 +1,33 @@
+//  Runtime performance counters
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#define ACKLATE 1000                                        // microseconds, an acknowledge taking longer than this is counted as late
+
+typedef struct {
+    unsigned long serialBytes;                              // characters received on serial 0
+    unsigned long lptBytes;                                 // characters received on the parallel port
+    unsigned long keys;                                     // keys decoded from the ps/2 keyboard
+    unsigned long glyphs;                                   // characters printed (not counting spaces)
+    unsigned long busWords;                                 // words sent to the Printer Board
+    unsigned long carrierMoves;                             // carrier moves, not counting the advance after each character
+    unsigned long paperMoves;                               // paper moves
+    unsigned long blockedMs;                                // milliseconds spent in ww_put_data()
+    unsigned int  blockedUs;                                // microseconds toward the next millisecond
+    unsigned int  rtsPauses;                                // times serial 0 was paused with RTS
+    unsigned int  ackLate;                                  // acknowledges that took longer than ACKLATE
+    unsigned char serialHighWater;                          // most characters ever waiting in the serial 0 buffer
+    unsigned char busHighWater;                             // most words ever waiting in the serial 1 buffer
+    unsigned int  busOverruns;                              // words dropped because the serial 1 buffer was full
+    unsigned int  kbOverruns;                               // scancodes dropped because the keyboard queue was full
+} stats_t;
+
+extern __xdata volatile stats_t stats;
+
+void stats_init(void);
+void stats_blocked(unsigned int us);
+void stats_dump(void);
+
+#endif
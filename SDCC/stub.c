@@ -0,0 +1,102 @@
+//  Stand-ins for the Wheelwriter and the PS/2 keyboard in the simulator
+//  for the Small Device C Compiler (SDCC)
+//
+//  Compiled in only when BUS_STUB is defined (see bench.bat). ucsim feeds serial 0 from
+//  bench.txt, but it can't put nine bit words on serial 1 or clock the PS/2 lines, so the
+//  words the Function Board would send and the scancodes of a key are played from
+//  stub_script[], one step on each timer 0 interrupt (see stub_tick()). A word is left in
+//  stubWord for uart1_isr() to read (see HAL_WW_RX), and a scancode is clocked in a bit at
+//  a time, each bit on the data pin and then INT1 raised for kb_isr() to read it.
+//
+//  EOT from bench.txt ends the run: once the script has been played and nothing is left to
+//  do, the execution times are printed and the simulator is stopped (see stub_idle()).
+
+#include "hal.h"
+#include "uart12.h"
+#include "prof.h"
+#include "stub.h"
+
+#define FALSE 0
+#define TRUE  1
+
+#define STUB_KEY  0x8000                                    // a scancode from the PS/2 keyboard
+#define STUB_WAIT 0x4000                                    // wait n timer 0 interrupts
+#define STUB_END  0xFFFF
+
+static __code unsigned int stub_script[] = {
+    0x121, 0x001, 0x020,                                    // the Function Board asks for the printwheel, the Printer Board has 12P
+    STUB_WAIT|4,
+    0x121, 0x003, 0x001, 0x00A,                             // 'a' typed on the Wheelwriter's keyboard
+    0x121, 0x006, 0x080, 0x00A,                             // the space bar
+    STUB_WAIT|4,
+    STUB_KEY|0x1C, STUB_KEY|0xF0, STUB_KEY|0x1C,            // 'a' pressed and released on the PS/2 keyboard
+    STUB_KEY|0x29, STUB_KEY|0xF0, STUB_KEY|0x29,            // the space bar
+    STUB_END
+};
+
+// ucsim's simulator interface (s51 -I if=xram[0xffff]): writing 's' stops the simulation
+__xdata __at(0xFFFF) volatile unsigned char stubSimif;
+
+volatile __data unsigned int stubWord;                      // the word on serial 1 (see HAL_WW_RX)
+__bit stub_eot = FALSE;                                     // bench.txt has ended
+unsigned char stubStep = 0;                                 // the next step of stub_script[]
+unsigned char stubWait = 0;                                 // timer 0 interrupts to wait
+unsigned char stubBits = 0;                                 // bits of stubFrame still to clock in
+unsigned int  stubFrame;                                    // start bit, scancode, parity and stop bit, lowest first
+
+extern volatile __bit waitingForAcknowledge;                // defined in wheelwriter.c
+
+//-----------------------------------------------------------
+// the next step of the script, called by timer0_isr(). a word
+// isn't put on serial 1 while ww_put_data() waits for its
+// acknowledge, the Function Board waits for the bus too.
+//-----------------------------------------------------------
+void stub_tick(void) __using(1) {
+    unsigned int w;
+    unsigned char i,p;
+
+    if (stubBits) {                                         // clocking a scancode in, a bit each time
+        kb_data_in = stubFrame & 0x01;
+        stubFrame >>= 1;
+        --stubBits;
+        IE1 = 1;                                            // the falling edge of the clock, kb_isr() reads the bit
+        return;
+    }
+    if (stubWait) {
+        --stubWait;
+        return;
+    }
+    if (RI1 || waitingForAcknowledge)
+        return;
+    w = stub_script[stubStep];
+    if (w == STUB_END)
+        return;
+    ++stubStep;
+    if (w & STUB_KEY) {
+        p = 1;                                              // odd parity
+        for (i=0; i<8; i++)
+            p ^= (w >> i) & 0x01;
+        stubFrame = ((w & 0xFF) << 1) | ((unsigned int)p << 9) | 0x400;
+        stubBits = 11;
+    }
+    else if (w & STUB_WAIT)
+        stubWait = w & 0xFF;
+    else {
+        stubWord = w;
+        RI1 = 1;                                            // received, uart1_isr() takes it
+    }
+}
+
+//-----------------------------------------------------------
+// called by main() when there's nothing to do. after EOT, once
+// the script is over, print the execution times, wait for them
+// to be sent, and stop the simulator.
+//-----------------------------------------------------------
+void stub_idle(void) {
+    if (!stub_eot || (stub_script[stubStep] != STUB_END) || stubBits)
+        return;
+    stub_eot = FALSE;                                       // (once, should the simulator carry on)
+    prof_dump();
+    uart_flush();
+    stubSimif = 's';
+}
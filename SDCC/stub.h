@@ -0,0 +1,16 @@
+//  Stand-ins for the Wheelwriter and the PS/2 keyboard in the simulator
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __STUB_H__
+#define __STUB_H__
+
+#ifdef BUS_STUB
+
+extern __bit stub_eot;
+
+void stub_tick(void) __using(1);
+void stub_idle(void);
+
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+// Post-mortem event trace
+// for the Small Device C Compiler (SDCC)
+//
+// A ring of the most recent bus words, parser input and buffer events kept in uninitialized
+// internal MOVX SRAM (like wdResets and printWheel in main.c) so that its contents survive a
+// watchdog reset and can be dumped on the console to see what happened before the hang.
+
+#include <stdio.h>
+#include "hal.h"
+#include "trace.h"
+
+#define TRACEKEY 0xA5                                       // marks the trace ring as valid
+
+// uninitialized variables in xdata RAM, contents unaffected by reset
+__xdata volatile unsigned char __at(0x0360) trace_buf[TRACE_SIZE*2];   // tag,value pairs
+__xdata volatile unsigned char __at(0x03E0) trace_idx;                 // index of the next entry to write
+__xdata volatile unsigned char __at(0x03E1) trace_key;                 // TRACEKEY when the ring is valid
+
+//-----------------------------------------------------------
+// empty the trace ring. called after a power on reset when
+// the contents of the ring are random.
+//-----------------------------------------------------------
+void trace_clear(void) {
+    unsigned char i;
+
+    for (i=0; i<TRACE_SIZE*2; i++)
+        trace_buf[i] = 0;
+    trace_idx = 0;
+    trace_key = TRACEKEY;
+}
+
+//-----------------------------------------------------------
+// keep the trace ring from the previous run if it is valid,
+// otherwise empty it.
+//-----------------------------------------------------------
+void trace_init(void) {
+    if ((trace_key != TRACEKEY) || (trace_idx & 0x01) || (trace_idx >= TRACE_SIZE*2))
+        trace_clear();
+}
+
+//-----------------------------------------------------------
+// record one entry in the trace ring from the main program.
+//-----------------------------------------------------------
+void trace_put(unsigned char tag, unsigned char value) __critical {
+    trace_buf[trace_idx] = tag;
+    trace_buf[trace_idx+1] = value;
+    trace_idx = (trace_idx+2) & ((TRACE_SIZE*2)-1);
+}
+
+//-----------------------------------------------------------
+// print the trace ring on the console, oldest entry first.
+//-----------------------------------------------------------
+void trace_dump(void) {
+    unsigned char i,n,tag,value;
+
+    printf("\nTrace (oldest first):\n");
+    i = trace_idx;                                          // the oldest entry is the next one to be overwritten
+    for (n=0; n<TRACE_SIZE; n++) {
+        tag = trace_buf[i];
+        value = trace_buf[i+1];
+        i = (i+2) & ((TRACE_SIZE*2)-1);
+        switch (tag & 0xF0) {
+            case TR_BUS_TX:
+                printf("TX  %03X\n",((tag & 0x01) << 8) | value);
+                break;
+            case TR_BUS_RX:
+                printf("RX  %03X\n",((tag & 0x01) << 8) | value);
+                break;
+            case TR_CHAR:
+                printf("CHR %02X esc=%u\n",(int)value,(int)(tag & 0x0F));
+                break;
+            case TR_RX_PAUSE:
+                printf("RTS pause  free=%u\n",(int)value);
+                break;
+            case TR_RX_RESUME:
+                printf("RTS resume free=%u\n",(int)value);
+                break;
+            case TR_KEY:
+                printf("KEY %02X\n",(int)value);
+                break;
+            // empty entries are not printed
+        }
+    }
+}
@@ -0,0 +1,33 @@
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __TRACE_H__
+#define __TRACE_H__
+
+#define TRACE_SIZE 64                                       // number of entries in the trace ring (must be a power of 2)
+
+// entry tags. the low nibble of the tag holds additional data for the entry.
+#define TR_BUS_TX   0x10                                    // word sent to the Printer Board, bit 0 = ninth bit
+#define TR_BUS_RX   0x20                                    // word read from the Wheelwriter BUS (see ww_get_data()), bit 0 = ninth bit
+#define TR_CHAR     0x30                                    // character into print_character(), low nibble = escape state
+#define TR_RX_PAUSE 0x40                                    // serial 0 paused (RTS high), value = buffer space remaining
+#define TR_RX_RESUME 0x50                                   // serial 0 resumed (RTS low), value = buffer space remaining
+#define TR_KEY      0x60                                    // key decoded from the ps/2 keyboard
+
+extern volatile __xdata unsigned char trace_buf[TRACE_SIZE*2];
+extern volatile __xdata unsigned char trace_idx;
+
+// records an entry from within an interrupt service routine. the ISRs that use it all run at
+// the same (low) priority so they never preempt one another.
+#define TRACE_ISR(tag,value) {                              \
+    trace_buf[trace_idx] = (tag);                           \
+    trace_buf[trace_idx+1] = (value);                       \
+    trace_idx = (trace_idx+2) & ((TRACE_SIZE*2)-1);         \
+}
+
+void trace_init(void);
+void trace_clear(void);
+void trace_put(unsigned char tag, unsigned char value) __critical;
+void trace_dump(void);
+
+#endif
+
@@ -0,0 +1,167 @@
+//  Teletype terminal mode
+//  for the Small Device C Compiler (SDCC)
+//
+//  The Wheelwriter's own keyboard is the host's input device and the Wheelwriter prints what
+//  the host sends back. parseWWdata() decodes the Function Board's commands into keys for
+//  tty_key(), which sends them to the host through serial 0, a key at a time in raw mode or a
+//  line at a time in cooked mode, where the erase key takes back the last character of the
+//  line. The Wheelwriter has already printed the keys, so tty_echo() tells task_serial() to
+//  drop the host's echo of them rather than print them a second time.
+//
+//  The PS/2 keyboard can be the host's input device too (<ESC><k><n>, or the Pause key).
+//  tty_host_key() sends its keys through serial 0 as a VT220/xterm keyboard would, the grey
+//  keys and function keys as escape sequences. The keys aren't printed; the host's echo is.
+
+#include "hal.h"
+#include "config.h"
+#include "uart12.h"
+#include "keyboard.h"
+#include "keycodes.h"
+#include "tty.h"
+
+#define FALSE 0
+#define TRUE  1
+#define LF    0x0A
+#define CR    0x0D
+#define DEL   0x7F
+#define ESC   0x1B
+
+#if ((TTY_ECHO & (TTY_ECHO-1)) != 0)
+    #error TTY_ECHO must be a power of 2.
+#endif
+
+__xdata unsigned char ttyLine[TTY_LINE];                    // the line being typed in cooked mode
+unsigned char ttyLength = 0;                                // characters in the line
+__xdata unsigned char ttyEcho[TTY_ECHO];                    // keys sent to the host, oldest first
+unsigned char ttyEchoHead = 0;
+unsigned char ttyEchoTail = 0;
+unsigned char ttyEchoLost = 0;                              // keys sent after the ring filled up, their echoes follow the ring's
+__bit ttyEchoLF = FALSE;                                    // the host's echo of CR may be followed by LF
+
+// send a key to the host and remember it for tty_echo(). once the ring is
+// full (a long line in cooked mode) the keys are only counted until their
+// echoes have come back, so that they are dropped in the same order.
+static void tty_send(unsigned char c) {
+    unsigned char next;
+
+    uart_putchar(c);
+    next = (ttyEchoHead+1) & (TTY_ECHO-1);
+    if (!ttyEchoLost && (next != ttyEchoTail)) {
+        ttyEcho[ttyEchoHead] = c;
+        ttyEchoHead = next;
+    }
+    else if (ttyEchoLost != 0xFF)
+        ++ttyEchoLost;
+}
+
+//-----------------------------------------------------------
+// a key typed on the Wheelwriter, decoded from the Function
+// Board's commands: a printable character, TAB, CR (Return),
+// BS (carrier back one character) or DEL (the erase key).
+// in raw mode BS goes to the host and DEL doesn't, because
+// the Function Board moves the carrier back before it erases.
+// in cooked mode DEL takes back the last character of the
+// line and BS is ignored.
+//-----------------------------------------------------------
+void tty_key(unsigned char key) {
+    unsigned char i;
+
+    if (TTY == TTY_RAW) {
+        if (key != DEL)
+            tty_send(key);
+        return;
+    }
+    switch (key) {
+        case CR:                                            // Return sends the line
+            for (i=0; i<ttyLength; i++)
+                tty_send(ttyLine[i]);
+            tty_send(CR);
+            ttyLength = 0;
+            break;
+        case DEL:
+            if (ttyLength)
+                --ttyLength;
+            break;
+        case 0x08:                                          // BS
+            break;
+        default:
+            if (ttyLength < TTY_LINE)                       // characters past the end of the line are lost
+                ttyLine[ttyLength++] = key;
+    }
+}
+
+//-----------------------------------------------------------
+// returns TRUE if 'c' from the host is its echo of the next
+// key sent, which the Wheelwriter has already printed. the
+// first character that isn't means the host isn't echoing,
+// so the keys still waiting for their echo are forgotten.
+//-----------------------------------------------------------
+__bit tty_echo(unsigned char c) {
+    if (ttyEchoLF) {
+        ttyEchoLF = FALSE;
+        if (c == LF)                                        // the Wheelwriter's Return has fed the paper already
+            return TRUE;
+    }
+    if (ttyEchoHead == ttyEchoTail) {                       // nothing in the ring...
+        if (!ttyEchoLost)                                   // ...or past it waiting for its echo
+            return FALSE;
+        --ttyEchoLost;                                      // the echo of a key past the ring, taken on trust
+        ttyEchoLF = (c == CR);
+        return TRUE;
+    }
+    if (c != ttyEcho[ttyEchoTail]) {
+        ttyEchoTail = ttyEchoHead;
+        ttyEchoLost = 0;
+        return FALSE;
+    }
+    ttyEchoTail = (ttyEchoTail+1) & (TTY_ECHO-1);
+    ttyEchoLF = (c == CR);
+    return TRUE;
+}
+
+// escape sequences for the PS/2 keys from PS2_KEY_HOME to PS2_KEY_F12 (see keycodes.h),
+// less the leading ESC. the keypad's keys are the same as the grey keys (num lock off).
+__code char * __code vtKeys[PS2_KEY_F12-PS2_KEY_HOME+1] = {
+    "[1~","[4~","[5~","[6~",                                // Home, End, PgUp, PgDn
+    "[D","[C","[A","[B",                                    // left, right, up, down
+    "[2~","[3~",                                            // Insert, Delete
+    "[1~","[4~","[A","[B","[C","[D","[5~","[6~","[2~","[3~",// keypad Home, End, up, down, right, left, PgUp, PgDn, Insert, Delete
+    "/","*","-","+","\r",                                  // keypad /, *, -, +, Enter (sent without the ESC)
+    "OP","OQ","OR","OS",                                    // F1-F4
+    "[15~","[17~","[18~","[19~","[20~","[21~","[23~","[24~" // F5-F12
+};
+
+//-----------------------------------------------------------
+// send a key from the PS/2 keyboard to the host. Ctrl makes
+// a control character of a letter, Alt sends ESC first (meta).
+// Backspace is DEL. keys with no sequence (the GUI and menu
+// keys, Print Screen) are dropped.
+//-----------------------------------------------------------
+void tty_host_key(unsigned char key) {
+    __code char *s;
+
+    if (kb_alt_pressed())
+        uart_putchar(ESC);
+    if (key < 0x80) {
+        if (key == PS2_KEY_BACKSPACE)
+            key = DEL;
+        else if (kb_ctrl_pressed() && (key >= '@'))
+            key &= 0x1F;
+        uart_putchar(key);
+    }
+    else if ((key >= PS2_KEY_HOME) && (key <= PS2_KEY_F12)) {
+        s = vtKeys[key-PS2_KEY_HOME];
+        if ((key < PS2_KEY_KP_DIV) || (key > PS2_KEY_KP_ENTER))
+            uart_putchar(ESC);
+        while (*s)
+            uart_putchar(*s++);
+    }
+}
+
+// forget the line being typed and the keys waiting for their echo, when the mode changes
+void tty_clear(void) {
+    ttyLength = 0;
+    ttyEchoTail = ttyEchoHead;
+    ttyEchoLost = 0;
+    ttyEchoLF = FALSE;
+}
@@ -0,0 +1,25 @@
+//  Teletype terminal mode
+//  for the Small Device C Compiler (SDCC)
+
+#ifndef __TTY_H__
+#define __TTY_H__
+
+#define TTY_LINE  80                                        // longest line held in cooked mode
+#define TTY_ECHO  32                                        // keys waiting for the host's echo (a power of 2)
+
+// the line discipline, kept in cfg.options (see config.h)
+#define TTY_OFF    CFG_TTY_OFF                              // keys typed on the Wheelwriter are echoed to the console
+#define TTY_RAW    CFG_TTY_RAW                              // each key goes to the host as it's typed
+#define TTY_COOKED CFG_TTY_COOKED                           // a line goes to the host when Return is pressed
+
+#define TTY (cfg.options & CFG_TTY_MASK)
+
+// the PS/2 keyboard's keys go to the host (see tty_host_key())
+#define KBHOST (cfg.options & CFG_KBHOST)
+
+void tty_key(unsigned char key);
+__bit tty_echo(unsigned char c);
+void tty_clear(void);
+void tty_host_key(unsigned char key);
+
+#endif
@@ -4,62 +4,109 @@
 //                                                                        //
 //************************************************************************//
 // Interrupt driven serial 0 functions with RTS/CTS handshaking.
-// serial 0 uses receive buffers in internal MOVX SRAM. serial 0 in mode 1
+// serial 0 uses receive and transmit buffers in internal MOVX SRAM. serial 0 in mode 1
 // uses timer 1 for baud rate generation. uart_init() must be called
 // before using UART. No syntax error checking.
 
 // for the Small Device C Compiler (SDCC)
 
-#include "reg420.h"
+#include "hal.h"
+#include "trace.h"
+#include "prof.h"
+#include "sched.h"
+#include "stats.h"
+#include "config.h"
+#include "journal.h"
 
 #define FALSE 0
 #define TRUE  1
+#define NUL   0x00
+#define ENQ   0x05                                       // status query from the host (see task_status() in main.c)
+#define SUB   0x1A                                       // ^Z
+#define ESC   0x1B
 
 //////////////////////////////////////// Serial 0 /////////////////////////////////////
 #define BUFFERSIZE 128
 #if BUFFERSIZE < 4
     #error BUFFERSIZE may not be less than 4.
-#elif BUFFERSIZE > 256
-    #error BUFFERSIZE may not be greater than 256.
+#elif BUFFERSIZE > 128
+    #error BUFFERSIZE may not be greater than 128 (the space below the trace ring).
 #elif ((BUFFERSIZE & (BUFFERSIZE-1)) != 0)
     #error BUFFERSIZE must be a power of 2.
 #endif
 
+#define TXSIZE 32                                        // transmit buffer, so that sending doesn't hold up printing
+#if ((TXSIZE & (TXSIZE-1)) != 0)
+    #error TXSIZE must be a power of 2.
+#endif
+
 #define PAUSELEVEL BUFFERSIZE/4                          // pause communications (RTS = 1) when buffer space < 32 bytes
 #define RESUMELEVEL BUFFERSIZE/2                         // resume communications (RTS = 0) when buffer space > 64 bytes
 
-__sbit __at (0xb6) CTS;
-__sbit __at (0xb7) RTS;
-
 volatile unsigned char rx_head;                          // receive write index for serial 0
 volatile unsigned char rx_tail;                          // receive read index for serial 0
 volatile unsigned char rx_remaining;                     // Receive buffer space remaining for serial 0
-volatile unsigned char __xdata rx_buf[BUFFERSIZE];       // receive buffer for serial 0 in internal MOVX RAM
-volatile __bit tx_ready;
+volatile unsigned char __xdata __at(0x02E0) rx_buf[BUFFERSIZE];  // receive buffer for serial 0 in internal MOVX RAM, unaffected by reset (see journal.h)
+volatile unsigned char tx_head;                          // transmit write index for serial 0
+volatile unsigned char tx_tail;                          // transmit read index for serial 0
+volatile unsigned char __xdata tx_buf[TXSIZE];           // transmit buffer for serial 0 in internal MOVX RAM
+volatile __bit tx_ready;                                 // the transmitter is idle
+volatile __bit uart_enq;                                 // ENQ was received, answer it (see task_query() in main.c)
+volatile __bit uart_stats;                               // <ESC><^Z><s> was received, send the counters
 
 // ---------------------------------------------------------------------------
 // Serial 0 interrupt service routine
 // ---------------------------------------------------------------------------
 void uart0_isr(void) __interrupt(4) __using(3) {
+   static unsigned char query = 0;                       // how much of <ESC><^Z><s> has been received
+   unsigned char c;
+
+   PROF_BEGIN(PROF_UART0_ISR);
    // serial 0 transmit interrupt
    if (TI) {                                             // transmit interrupt?
       TI = FALSE;                                        // clear transmit interrupt flag
-      tx_ready = TRUE;                                   // transmit buffer is ready for a new character
+      if (tx_head != tx_tail) {                          // send the next character waiting...
+         HAL_UART0_TX(tx_buf[tx_tail]);
+         tx_tail = (tx_tail+1) & (TXSIZE-1);
+      }
+      else
+         tx_ready = TRUE;                                // ...or the transmitter is idle
     }
 
     // serial 0 receive interrupt
     if(RI) {                                             // receive character?
         RI = 0;                                          // clear serial receive interrupt flag
-        rx_buf[rx_head] = SBUF0;                         // Get character from serial port and put into serial 0 fifo.
-        rx_head = ++rx_head &(BUFFERSIZE-1);
+        c = SBUF0;                                       // Get character from serial port...
+        if (c == ENQ) {                                  // ...a status query is answered at once, ahead of the characters waiting
+            uart_enq = TRUE;
+            sched_post(EV_STATUS);
+        }
+        else {
+            if ((query == 2) && ((c == 's') || (c == 'S'))) { // so are the counters. print_character() sees <ESC><^Z><NUL> and ignores it
+                c = NUL;
+                uart_stats = TRUE;
+                sched_post(EV_STATUS);
+            }
+            query = (c == ESC) ? 1 : ((query == 1) && (c == SUB)) ? 2 : 0;
+            rx_buf[rx_head] = c;                         // ...or put it into serial 0 fifo.
+            rx_head = ++rx_head &(BUFFERSIZE-1);
+            journal.rxHead = rx_head;
+            sched_post(EV_SERIAL);
 
-      --rx_remaining;                                    // space remaining in serial 0 buffer decreases
-        if (!RTS){                                       // if communications is not now paused...
-            if (rx_remaining < PAUSELEVEL) {
-               RTS = 1;                                  // pause communications when space in serial buffer decreases to less than 32 bytes
+            --rx_remaining;                              // space remaining in serial 0 buffer decreases
+            ++stats.serialBytes;
+            if (BUFFERSIZE-rx_remaining > stats.serialHighWater)
+                stats.serialHighWater = BUFFERSIZE-rx_remaining;
+            if (!RTS){                                   // if communications is not now paused...
+                if (rx_remaining < PAUSELEVEL) {
+                   RTS = 1;                              // pause communications when space in serial buffer decreases to less than 32 bytes
+                   ++stats.rtsPauses;
+                   TRACE_ISR(TR_RX_PAUSE,rx_remaining);
+                }
             }
         }
     }
+    PROF_END(PROF_UART0_ISR);
 }
 
 // ---------------------------------------------------------------------------
@@ -71,6 +118,8 @@ void uart_init(void) {
     rx_head = 0;                                         // initialize head/tail pointers.
     rx_tail = 0;
     rx_remaining = BUFFERSIZE;                           // 256 characters
+    tx_head = 0;
+    tx_tail = 0;
     SCON0 = 0x50;                                        // Serial 0 for mode 1.
     TMOD = (TMOD & 0x0F) | 0x20;                         // Timer 1, mode 2, 8-bit reload.
     CKMOD |= 0x10;                                       // Make timer 1 clocked by OSC/1 instead of the default OSC/12
@@ -83,6 +132,64 @@ void uart_init(void) {
     RTS = 0;                                             // clear RTS to allow transmissions from remote console
 }
 
+__code unsigned char baudReload[4] = {0x64,0xB2,0xD9,0xD9};   // timer 1 reload for 2404, 4808, 9615 and (doubled) 19231 bps
+
+// ---------------------------------------------------------------------------
+// select the serial 0 bit rate (BAUD_2400 to BAUD_19200). timer 1 is clocked at
+// OSC/1, bps = 12MHz/(32*(256-TH1)), doubled when SMOD_0 (PCON.7) is set.
+// ---------------------------------------------------------------------------
+void uart_baud(unsigned char rate) {
+    if (rate > BAUD_19200)
+        rate = BAUD_9600;
+    TH1 = baudReload[rate];
+    if (rate == BAUD_19200)
+        PCON |= 0x80;                                    // SMOD_0 doubles the bit rate
+    else
+        PCON &= 0x7F;
+}
+
+// ---------------------------------------------------------------------------
+// after a watchdog reset, pick up the characters that were still waiting in the
+// receive buffer. called after uart_init() and before interrupts are enabled.
+// ---------------------------------------------------------------------------
+void uart_resume(unsigned char head, unsigned char tail) {
+    rx_head = head & (BUFFERSIZE-1);
+    rx_tail = tail & (BUFFERSIZE-1);
+    rx_remaining = BUFFERSIZE-((rx_head-rx_tail) & (BUFFERSIZE-1));
+    if (rx_remaining < PAUSELEVEL)
+        RTS = 1;                                         // pause communications until there's room
+}
+
+// ---------------------------------------------------------------------------
+// pause serial 0 (RTS high) before holding off the interrupts for a while,
+// and resume it afterwards unless the receive buffer has filled up meanwhile,
+// in which case uart_getchar() resumes it as usual.
+// ---------------------------------------------------------------------------
+void uart_hold(void) {
+   RTS = 1;
+}
+
+void uart_release(void) {
+   if (rx_remaining > RESUMELEVEL)
+      RTS = 0;
+}
+
+// ---------------------------------------------------------------------------
+// returns 1 while the characters read since the read index was 'tail' are safe
+// from the host: with RTS raised below PAUSELEVEL, and a few characters still
+// arriving after that, the receive buffer won't wrap around onto them.
+// ---------------------------------------------------------------------------
+__bit uart_kept(unsigned char tail) {
+   return ((rx_tail-tail) & (BUFFERSIZE-1)) < PAUSELEVEL/2;
+}
+
+// ---------------------------------------------------------------------------
+// returns the space remaining in the serial 0 receive buffer
+// ---------------------------------------------------------------------------
+unsigned char uart_free(void) {
+   return rx_remaining;
+}
+
 // ---------------------------------------------------------------------------
 // returns 1 if there are character waiting in the serial 0 receive buffer
 // ---------------------------------------------------------------------------
@@ -90,6 +197,14 @@ __bit uart_char_avail(void) {
    return (rx_head != rx_tail);
 }
 
+//-----------------------------------------------------------
+// returns the next character in the serial 0 receive buffer
+// without taking it. call only when uart_char_avail().
+//-----------------------------------------------------------
+char uart_peek(void) {
+    return rx_buf[rx_tail];
+}
+
 //-----------------------------------------------------------
 // waits until a character is available in the serial 0 receive
 // buffer. returns the character. does not echo the character.
@@ -97,7 +212,7 @@ __bit uart_char_avail(void) {
 char uart_getchar(void) {
     unsigned char buf;
 
-    while (rx_head == rx_tail);                          // wait until a character is available
+    HAL_WAIT(rx_head != rx_tail);                        // wait until a character is available
     buf = rx_buf[rx_tail];
     rx_tail = ++rx_tail &(BUFFERSIZE-1);
 
@@ -105,22 +220,44 @@ char uart_getchar(void) {
     if (RTS) {                                           // if communication is now paused...
          if (rx_remaining > RESUMELEVEL) {
             RTS = 0;                                     // clear RTS to resume communications when space remaining in buffer increases above 64 bytes
+            trace_put(TR_RX_RESUME,rx_remaining);
          }
     }
     return(buf);
 }
 
 // ---------------------------------------------------------------------------
-// sends one character out to serial 0.
+// sends one character out to serial 0. it goes straight to the transmitter if
+// that's idle, otherwise into the transmit buffer for the ISR to send. waits
+// only when the buffer is full.
 // ---------------------------------------------------------------------------
 char uart_putchar(char c)  {
-   while (!tx_ready);                                    // wait here for transmit ready
+   unsigned char next;
+
+   next = (tx_head+1) &(TXSIZE-1);
+   HAL_WAIT(next != tx_tail);                            // wait here for room in the buffer
    //while (CTS);                                        // wait here for clear to send
-   SBUF0 = c;
-   tx_ready = 0;
+   ES0 = FALSE;                                          // the ISR mustn't find the buffer empty and go idle in between
+   if (tx_ready) {
+      tx_ready = FALSE;
+      HAL_UART0_TX(c);
+   }
+   else {
+      tx_buf[tx_head] = c;
+      tx_head = next;
+   }
+   ES0 = TRUE;
    return (c);
 }
 
+// ---------------------------------------------------------------------------
+// waits until every character in the transmit buffer has been sent, the last
+// one out of the transmitter too.
+// ---------------------------------------------------------------------------
+void uart_flush(void) {
+   HAL_WAIT(tx_ready);
+}
+
 
 
 
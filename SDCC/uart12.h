@@ -3,11 +3,23 @@
 #ifndef __UART12_H__
 #define __UART12_H__
 
+extern volatile unsigned char rx_tail;                   // serial 0 receive read index, for the journal
+extern volatile __bit uart_enq;                          // the queries taken out of the serial 0 stream (see task_query())
+extern volatile __bit uart_stats;
+
 void uart0_isr(void) __interrupt(4) __using(3);
 void uart_init(void);
+void uart_baud(unsigned char rate);
+void uart_resume(unsigned char head, unsigned char tail);
 __bit uart_char_avail(void);
+unsigned char uart_free(void);
+__bit uart_kept(unsigned char tail);
 char uart_getchar(void);
+char uart_peek(void);
 char uart_putchar(char c);
+void uart_flush(void);
+void uart_hold(void);
+void uart_release(void);
 
 #endif
 
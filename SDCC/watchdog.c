@@ -1,7 +1,7 @@
 //  Watchdog functions
 //  for the Small Device C Compiler (SDCC)
 
-#include "reg420.h"
+#include "hal.h"
 
 //-----------------------------------------------------------
 // clear watchdog timer and POR flags
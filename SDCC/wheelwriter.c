@@ -1,13 +1,20 @@
 // Wheelwriter functions
 // for the Small Device C Compiler (SDCC)
 
-#include "reg420.h"
+#include "hal.h"
+#include "trace.h"
+#include "prof.h"
+#include "sched.h"
+#include "stats.h"
+#include "wheelwriter.h"
 
 #define FALSE 0
 #define TRUE  1
 #define ON 0                                        // 0 turns the amber LED on
 #define OFF 1                                       // 1 turns the amber LED off
 #define BUFFSIZE 16
+#define LNSIZE 48                                   // strikes held back for ordering (see ww_order_strike())
+#define LNWINDOW 6                                  // strikes considered each time
 
 #if BUFFSIZE < 2
     #error BUFFSIZE may not be less than 2.
@@ -20,24 +27,67 @@
 unsigned char uSpacesPerChar = 10;                  // micro spaces per character (8 for 15cpi, 10 for 12cpi and PS, 12 for 10cpi)
 unsigned char uLinesPerLine = 16;                   // micro lines per line (12 for 15cpi; 16 for 10cpi, 12cpi and PS)
 unsigned int  uSpaceCount = 0;                      // number of micro spaces on the current line (for carriage return)
-
-__sbit __at (0x85) amberLED;                        // amber LED connected to pin 34 0=on, 1=off
-__sbit __at (0x92) WWbus;                           // P1.2, (RXD1, pin 3) used to monitor the Wheelwriter BUS
+unsigned int  uLineCount = 0;                       // micro lines the paper has moved up since reset (for the correction memory)
+
+// draft printing: underlining waiting to be struck in one pass (see ww_flush())
+unsigned int  ulStart;                              // micro space count at the start of the run
+unsigned char ulCells = 0;                          // characters in the run
+unsigned char ulPitch;                              // micro spaces per character in the run
+
+// strike ordering: strikes waiting to be struck in the order that turns the printwheel least (see ww_order_strike())
+unsigned char lnOpen = FALSE;                       // TRUE while strikes are being held back
+unsigned int  lnCarrier;                            // micro space count where the carrier actually is
+unsigned char lnCount = 0;                          // strikes held back
+unsigned char __xdata lnCode[LNSIZE];               // printwheel code of each strike
+unsigned int  __xdata lnPos[LNSIZE];                // micro space count of each strike
+__bit lnAdvance;                                    // TRUE while the last print command waits for its advance
+unsigned char wheelCode = 0x01;                     // printwheel code last struck ('a' after the power on spin)
+
+// correction memory: the characters printed, newest last (see ww_erase_last())
+unsigned char __xdata cmBuf[CMSIZE];
+unsigned char cmHead = 0;                           // where the next entry goes
+unsigned int  cmUsed = 0;                           // bytes of cmBuf in use
+unsigned int  cmPos;                                // micro space count of the newest character
+unsigned int  cmLine;                               // micro line count of the newest character
+__bit cmLent = FALSE;                               // cmBuf is lent out, nothing is remembered (see ww_lend_memory())
 
 ///////////////////////////// Serial 1 interface to Wheelwriter ////////////////////////////
 volatile unsigned char __data rx1_head;             // receive interrupt index for serial 1
 volatile unsigned char __data rx1_tail;             // receive read index for serial 1
-volatile unsigned int __xdata rx1_buf[BUFFSIZE];    // receive buffer for serial 1
+volatile unsigned char __xdata rx1_lo[BUFFSIZE];   // receive buffer for serial 1, lower 8 bits of each word
+volatile unsigned char __xdata rx1_hi[BUFFSIZE];   // receive buffer for serial 1, ninth bit of each word
 volatile __bit tx1_ready;                           // set when ready to transmit
 volatile __bit waitingForAcknowledge = 0;           // TRUE when expecting the acknowledge pulse from Wheelwriter
 
+// save a word in the serial 1 receive buffer. if the buffer is full the word is dropped
+// and counted rather than overwriting the words that haven't been read yet. the trace
+// and the high water mark are left to ww_get_data(), out of the interrupt. a PROFILE
+// build starts timing the wake-up here (see prof.h).
+#define RX1_PUT(lo,ninth) {                                                          \
+    next = (rx1_head+1) & (BUFFSIZE-1);                                              \
+    if (next == rx1_tail) {                                                          \
+        ++stats.busOverruns;                                                         \
+    }                                                                                \
+    else {                                                                           \
+        rx1_lo[rx1_head] = (lo);                                                     \
+        rx1_hi[rx1_head] = (ninth);                                                  \
+        rx1_head = next;                                                             \
+        sched_post(EV_BUS);                                                          \
+        PROF_BUS_WOKE();                                                             \
+    }                                                                                \
+}
+
 // ---------------------------------------------------------------------------
 // Serial 1 interrupt service routine
+// a word can arrive every 59 microseconds (11 bits at 187500 bps), so this is kept to
+// 8 bit operations on bank 3 registers: no int arithmetic, no division, no library calls,
+// and no xdata other than the buffer itself (and the overrun count, when it's full).
 // ---------------------------------------------------------------------------
 void uart1_isr(void) __interrupt(7) __using(3) {
-   unsigned int wwBusData;
-   static char count = 0;
+    static __data unsigned char odd = 0;            // set for the 1st, 3rd, 5th... word after 0x121
+    unsigned char lo,ninth,next;
 
+    PROF_BEGIN(PROF_UART1_ISR);
     // serial 1 transmit interrupt
     if (TI1) {                                      // transmit interrupt?
       TI1 = FALSE;                                  // clear transmit interrupt flag
@@ -47,31 +97,24 @@ void uart1_isr(void) __interrupt(7) __using(3) {
     //serial 1 receive interrupt
     if(RI1) {                                       // receive interrupt?
        RI1 = 0;                                     // clear receive interrupt flag
-       wwBusData = SBUF1;                           // retrieve the lower 8 bits
-       if (RB81) wwBusData |= 0x0100;               // ninth bit is in RB81
+       HAL_WW_RX(lo,ninth);                         // the lower 8 bits from SBUF1, the ninth bit from RB81
 
        // discard the acknowledge pulse (all zeros)
        if (waitingForAcknowledge) {                 // just transmitted a command, waiting for acknowledge...
           waitingForAcknowledge = FALSE;            // clear the flag
-          if (wwBusData) {                          // if it's not acknowledge (all zeros) ...
-             rx1_buf[rx1_head] = wwBusData;         // save it in the buffer
-             rx1_head = ++rx1_head & (BUFFSIZE-1);
-          }
-      }
+          if (lo || ninth)                          // if it's not acknowledge (all zeros) ...
+             RX1_PUT(lo,ninth);                     // save it in the buffer
+       }
        else {                                       // not waiting for acknowledge...
-          if (wwBusData == 0x121) {
-              count = 1;
-          }
-          else {
-             ++count;
-          }
-
-         if (wwBusData || (count%2)) {              // if wwBusData is not zero or if it's the second zero...
-             rx1_buf[rx1_head] = wwBusData;         // save it in the buffer
-             rx1_head = ++rx1_head & (BUFFSIZE-1);
-         }
+          if (ninth && (lo == 0x21))                // 0x121 starts a command
+             odd = 1;
+          else
+             odd ^= 1;
+          if (lo || ninth || odd)                   // if the word is not zero or if it's the second zero...
+             RX1_PUT(lo,ninth);                     // save it in the buffer
        }
     }
+    PROF_END(PROF_UART1_ISR);
 }
 
 // ---------------------------------------------------------------------------
@@ -87,6 +130,7 @@ void uart1_isr(void) __interrupt(7) __using(3) {
 void ww_init(void) {
     rx1_head = 0;                                   // initialize serial 1 head/tail pointers.
     rx1_tail = 0;
+    tx1_ready = TRUE;                               // ready for the first word (setting TI1 below does the same once interrupts are enabled)
     SMOD_1 = FALSE;                                 // SMOD_1=0 therefor Serial 1 baud rate is oscillator freq (12 MHz) divided by 64 (187500 bps)
     SM01 = TRUE;                                    // SM01=1, SM11=0, SM21=0 sets serial mode 2
     SM11 = FALSE;
@@ -101,18 +145,27 @@ void ww_init(void) {
 // sends an unsigned integer to the Wheelwriter as 11 bits (start bit, 9 data bits, stop bit)
 // ---------------------------------------------------------------------------
 void ww_put_data(unsigned int wwCommand) {
-   while (!tx1_ready);                              // wait until transmit buffer is empty
+   unsigned int start,ackStart,end;
+
+   PROF_BEGIN(PROF_BUSWORD);
+   HAL_TIMER2_READ(start);
+   trace_put(TR_BUS_TX|((wwCommand>>8)&0x01),wwCommand&0xFF);
+   HAL_WAIT(tx1_ready);                             // wait until transmit buffer is empty
    tx1_ready = 0;                                   // clear flag
-   while(!WWbus);                                   // wait until the Wheelwriter bus goes high
+   HAL_WAIT(WWbus);                                 // wait until the Wheelwriter bus goes high
    REN1 = FALSE;                                    // disable reception
-   TB8_1 = (wwCommand & 0x100);                     // ninth bit
-   SBUF1 = wwCommand & 0xFF;                        // lower 8 bits
-   while(!tx1_ready);                               // wait until finished transmitting
+   HAL_WW_TX(wwCommand);                            // ninth bit and lower 8 bits
+   HAL_WAIT(tx1_ready);                             // wait until finished transmitting
    REN1 = TRUE;                                     // enable reception
    waitingForAcknowledge = TRUE;                    // just transmitted a command, now waiting for acknowledge
-   while(!WWbus);                                   // wait until the Wheelwriter bus goes high
-   while(WWbus);                                    // wait until the Wheelwriter bus goes low (acknowledge)
-   while(!WWbus);                                   // wait until the Wheelwriter bus goes high again
+   HAL_TIMER2_READ(ackStart);
+   HAL_WW_WAIT_ACK();                               // wait until the Wheelwriter bus goes high, low (acknowledge), high again
+   HAL_TIMER2_READ(end);
+   ++stats.busWords;
+   if (end-ackStart > ACKLATE)
+      ++stats.ackLate;
+   stats_blocked(end-start);                        // time spent here, timer 2 wraps after 65 milliseconds
+   PROF_END(PROF_BUSWORD);
 }
 
 // ---------------------------------------------------------------------------
@@ -122,16 +175,30 @@ __bit ww_data_avail(void) {
    return (rx1_head != rx1_tail);                   // not equal means there's something in the buffer
 }
 
+// ---------------------------------------------------------------------------
+// returns the space remaining in the serial 1 receive buffer.
+// ---------------------------------------------------------------------------
+unsigned char ww_data_free(void) {
+   return (BUFFSIZE-1)-((rx1_head-rx1_tail) & (BUFFSIZE-1));
+}
+
 //----------------------------------------------------------------------------
 // returns the next unsigned integer from the Wheelwriter in the serial 1 receive buffer.
 // waits for an integer to become available if necessary.
 //----------------------------------------------------------------------------
 unsigned int ww_get_data(void) {
     unsigned int buf;
-
-    while (rx1_head == rx1_tail);                   // wait until a word is available
-    buf = rx1_buf[rx1_tail];                        // retrieve the word from the buffer
+    unsigned char n;
+
+    HAL_WAIT(rx1_head != rx1_tail);                 // wait until a word is available
+    n = (rx1_head-rx1_tail) & (BUFFSIZE-1);         // words waiting, the most there have been since the last one was read
+    if (n > stats.busHighWater)
+        stats.busHighWater = n;
+    buf = rx1_lo[rx1_tail];                         // retrieve the word from the buffer
+    if (rx1_hi[rx1_tail])
+        buf |= 0x100;
     rx1_tail = ++rx1_tail & (BUFFSIZE-1);
+    trace_put(TR_BUS_RX|(buf>>8),buf&0xFF);
     return(buf);
 }
 
@@ -167,21 +234,204 @@ char __code ASCII2printwheel[96] =  {
        0x5C,0x52,0x03,0x06,0x5E,0x5B,0x53,0x55,0x51,0x58,0x54,0x48,0x43,0x47,0x44,0x00}; // 70
 //------------------------------------------------------------------------------------------------
 
-// backspace, no erase. decreases micro space count by uSpacesPerChar.
+// move the carrier "d" micro spaces, to the right if positive, to the left if negative.
+// the micro space count is left to the caller.
+static void ww_carrier_move(int d) {
+    ++stats.carrierMoves;
+    ww_put_data(0x121);
+    ww_put_data(0x006);                     // move the carrier horizontally
+    if (d < 0) {
+        d = -d;
+        ww_put_data((d>>8)&0x007);          // bit 7 is cleared for right to left direction
+    }
+    else
+        ww_put_data(((d>>8)&0x007)|0x80);   // bit 7 is set for left to right direction
+    ww_put_data(d&0xFF);                    // lower 8 bits of micro spaces
+}
+
+// move the paper "lines" micro lines, up if positive, down if negative, up to 31 micro
+// lines at a time. the micro line count is left to the caller.
+static void ww_paper_move(int lines) {
+    unsigned char skip;
+
+    while (lines) {
+        ++stats.paperMoves;
+        ww_put_data(0x121);
+        ww_put_data(0x005);                 // vertical movement
+        if (lines > 0) {
+            skip = (lines > 0x1F) ? 0x1F : lines;
+            ww_put_data(0x080|skip);        // bit 7 is set to indicate paper up direction
+            lines -= skip;
+        }
+        else {
+            skip = (lines < -0x1F) ? 0x1F : -lines;
+            ww_put_data(skip);              // bit 7 is cleared to indicate paper down direction
+            lines += skip;
+        }
+    }
+}
+
+// predicted time, in units of 10 microseconds, to turn the printwheel from
+// "from" to "to" while the carrier moves "d" micro spaces. the printwheel
+// turns the shorter way round its 96 positions and the carrier moves at the
+// same time, so the longer of the two counts (see host/wwtime.c).
+static unsigned int ww_strike_cost(unsigned char from,unsigned char to,int d) {
+    unsigned char n;
+    unsigned int wheel,carrier;
+
+    n = (from > to) ? from-to : to-from;
+    if (n > 48)
+        n = 96-n;                           // the shorter way round
+    wheel = n ? n*55+400 : 0;               // 0.55ms per position plus 4ms to settle
+    if (d < 0)
+        d = -d;
+    carrier = d ? d*22+600 : 0;             // 0.22ms per micro space plus 6ms to start and stop
+    return (wheel > carrier) ? wheel : carrier;
+}
+
+// move the carrier from where the last strike was made to micro space count "to". the
+// print command of the last strike is still waiting for its advance: a move to the right
+// goes in the advance, a move to the left needs a carrier move of its own.
+static void ww_order_move(unsigned int to) {
+    int d;
+
+    d = to-lnCarrier;
+    if (lnAdvance) {
+        lnAdvance = FALSE;
+        if ((d >= 0) && (d < 0x100)) {
+            ww_put_data(d);                 // advance to the next strike
+            d = 0;
+        }
+        else
+            ww_put_data(0x000);             // advance zero micro spaces
+    }
+    if (d)
+        ww_carrier_move(d);
+    lnCarrier = to;
+}
+
+//-----------------------------------------------------------
+// Strike ordering (attribute bit 4) holds back the strikes of
+// a line and then makes them in an order that turns the
+// printwheel less than left to right does, so that the same or
+// neighbouring letters on the printwheel are struck together.
+// Each time the next strike is the cheapest to reach from the
+// last, counting the printwheel's rotation and the carrier's
+// travel, among the first LNWINDOW strikes not made yet. The
+// window keeps the carrier from skipping far ahead and having
+// to come back for what it passed over, and bounds the work to
+// LNWINDOW comparisons a strike. Leaves the carrier at micro
+// space count "to".
+//-----------------------------------------------------------
+static void ww_order_strike(unsigned int to) {
+    unsigned char i,best;
+    unsigned int cost,least;
+
+    lnOpen = FALSE;
+    amberLED = ON;                          // turn on amber LED
+    while (lnCount) {
+        least = 0xFFFF;
+        best = 0;
+        for (i=0; (i<lnCount) && (i<LNWINDOW); i++) {
+            cost = ww_strike_cost(wheelCode,lnCode[i],lnPos[i]-lnCarrier);
+            if (cost < least) {
+                least = cost;
+                best = i;
+            }
+        }
+        ww_order_move(lnPos[best]);
+        wheelCode = lnCode[best];
+        ww_put_data(0x121);
+        ww_put_data(0x003);
+        ww_put_data(wheelCode);
+        lnAdvance = TRUE;                   // the advance is sent with the next move
+        --lnCount;
+        for (i=best; i<lnCount; i++) {      // keep the rest in order from left to right
+            lnCode[i] = lnCode[i+1];
+            lnPos[i] = lnPos[i+1];
+        }
+    }
+    ww_order_move(to);
+    amberLED = OFF;                         // turn off amber LED
+}
+
+// hold back a strike of printwheel "code" at micro space count "pos" for ww_order_strike()
+static void ww_order_add(unsigned char code,unsigned int pos) {
+    if (code) {                             // code 0 is a space, nothing to strike
+        lnCode[lnCount] = code;
+        lnPos[lnCount] = pos;
+        ++lnCount;
+    }
+}
+
+//-----------------------------------------------------------
+// Strikes everything that is being held back: the line held
+// for strike ordering and the draft underlining.
+// Draft printing strikes the underlining of a run of characters
+// in one pass after the run instead of after each character, so
+// the printwheel doesn't turn back and forth between the letters
+// and the underscore. Moves the carrier back to the start of the
+// run and strikes an underscore in each position, which leaves
+// the carrier where it was. Called before anything else moves the
+// carrier or the paper.
+//-----------------------------------------------------------
+void ww_flush(void) {
+    unsigned char n;
+    unsigned int back;
+
+    if (lnOpen)
+        ww_order_strike(uSpaceCount);       // back to where the next character goes
+    if (!ulCells)
+        return;
+    n = ulCells;
+    ulCells = 0;
+    back = uSpaceCount-ulStart;
+    amberLED = ON;                          // turn on amber LED
+    ++stats.carrierMoves;
+    ww_put_data(0x121);
+    ww_put_data(0x006);                     // move the carrier horizontally
+    ww_put_data((back>>8)&0x007);           // bit 7 is cleared for right to left direction, bits 0-2 = upper 3 bits of micro spaces
+    ww_put_data(back&0xFF);                 // lower 8 bits of micro spaces
+    while (n--) {
+        ww_put_data(0x121);
+        ww_put_data(0x003);
+        ww_put_data(0x04F);                 // print '_' underscore
+        ww_put_data(ulPitch);               // advance to the next character in the run
+    }
+    wheelCode = 0x04F;
+    amberLED = OFF;                         // turn off amber LED
+}
+
+// returns the strikes held back (draft underlining, strike ordering) and not yet sent to the Printer Board
+unsigned char ww_held(void) {
+    return lnCount+ulCells;
+}
+
+// backspace, no erase. decreases micro space count by uSpacesPerChar,
+// or less if that would pass the left margin (the pitch may have changed on the line).
 void ww_backspace(void) {
+    unsigned char s;
+
+    ww_flush();
+    s = (uSpaceCount < uSpacesPerChar) ? uSpaceCount : uSpacesPerChar;
+    if (!s)                                         // already at the left margin
+        return;
     amberLED = ON;                                  // turn on amber LED
+    ++stats.carrierMoves;
     ww_put_data(0x121);
     ww_put_data(0x006);                             // move the carrier horizontally
     ww_put_data(0x000);                             // bit 7 is cleared for right to left direction
-    ww_put_data(uSpacesPerChar);
-    uSpaceCount -= uSpacesPerChar;
+    ww_put_data(s);
+    uSpaceCount -= s;
     amberLED = OFF;                                 // turn off amber LED
 }
 
 // backspace 1/120 inch. decrements micro space count
 void ww_micro_backspace(void) {
+    ww_flush();
     if (uSpaceCount){                               // only if the carrier is not at the left margin
         amberLED = ON;                              // turn on amber LED
+        ++stats.carrierMoves;
         ww_put_data(0x121);
         ww_put_data(0x006);                         // move the carrier horizontally
         ww_put_data(0x000);                         // bit 7 is cleared for right to left direction
@@ -197,7 +447,14 @@ void ww_micro_backspace(void) {
 // word. Bit 7 of the 3rd word is cleared to indicate carriage movement left direction.
 // resets micro space count back to zero.
 void ww_carriage_return(void) {
+    if (lnOpen) {                           // strike the line held back for ordering...
+        ww_order_strike(0);                 // ...and return from wherever the last strike was
+        uSpaceCount = 0;
+        return;
+    }
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.carrierMoves;
     ww_put_data(0x121);
     ww_put_data(0x006);                     // move the carrier horizontallly
     ww_put_data((uSpaceCount>>8)&0x007);    // bit 7 is cleared for right to left direction, bits 0-2 = upper 3 bits of micro spaces to left margin
@@ -206,6 +463,22 @@ void ww_carriage_return(void) {
     amberLED = OFF;                         // turn off amber LED
 }
 
+// drive the carrier to the left margin from wherever it physically is, when uSpaceCount can't be
+// trusted (see jr_resume()): a move to the left by the most micro spaces a command can carry,
+// more than the whole travel, which the Printer Board ends at the left margin. resets micro
+// space count back to zero.
+void ww_carrier_home(void) {
+    ww_flush();
+    amberLED = ON;                          // turn on amber LED
+    ++stats.carrierMoves;
+    ww_put_data(0x121);
+    ww_put_data(0x006);                     // move the carrier horizontally
+    ww_put_data(0x007);                     // bit 7 is cleared for right to left direction, upper 3 bits of 0x7FF micro spaces
+    ww_put_data(0xFF);                      // lower 8 bits
+    uSpaceCount = 0;
+    amberLED = OFF;                         // turn off amber LED
+}
+
 // ww_spins the printwheel as a visual and audible indication
 void ww_spin(void) {
     amberLED = ON;                          // turn on amber LED
@@ -214,12 +487,11 @@ void ww_spin(void) {
     amberLED = OFF;                         // turn off amber LED
 }
 
-// horizontal tab number of "spaces". updates micro space count.
-void ww_horizontal_tab(unsigned char spaces) {
-    unsigned int s;
-
-    s = spaces*uSpacesPerChar;              // number of microspaces to move right
+// move the carrier right "s" micro spaces. updates micro space count.
+void ww_carrier_right(unsigned int s) {
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.carrierMoves;
     ww_put_data(0x121);
     ww_put_data(0x006);                     // move the carrier horizontally
     ww_put_data(((s>>8)&0x007)|0x80);       // bit 7 is set for left to right direction, bits 0-2 = upper 3 bits of micro spaces to move right
@@ -228,98 +500,297 @@ void ww_horizontal_tab(unsigned char spaces) {
     amberLED = OFF;                         // turn off amber LED
 }
 
-// backspaces and erases "letter". updates micro space count.
-// Note: erasing bold or underlined characters or characters on lines other than the current line not implemented yet.
-void ww_erase_letter(unsigned char letter) {
-     amberLED = ON;                          // turn on amber LED
-     ww_put_data(0x121);
-     ww_put_data(0x006);                     // move the carrier horizontally
-     ww_put_data(0x000);                     // bit 7 is cleared for right to left direction
-     ww_put_data(uSpacesPerChar);            // number of micro spaces to move left
-     ww_put_data(0x121);
-     ww_put_data(0x004);                     // print on correction tape
-     ww_put_data(ASCII2printwheel[letter-0x20]);
-     ww_put_data(uSpacesPerChar);            // number of micro spaces to move right
-     uSpaceCount -= uSpacesPerChar;          // update the micro space count
-     amberLED = OFF;                         // turn off amber LED
+// move the carrier straight to micro space count "pos" and the paper to micro line count
+// "line" (see uLineCount). updates both counts.
+void ww_move_to(unsigned int pos,unsigned int line) {
+    ww_flush();
+    amberLED = ON;                          // turn on amber LED
+    ww_paper_move(line-uLineCount);
+    if (pos != uSpaceCount)
+        ww_carrier_move(pos-uSpaceCount);
+    uSpaceCount = pos;
+    uLineCount = line;
+    amberLED = OFF;                         // turn off amber LED
+}
+
+// horizontal tab number of "spaces". updates micro space count.
+// like a letter, a tab past the right stop returns the carrier to the left margin.
+void ww_horizontal_tab(unsigned char spaces) {
+    if (uSpaceCount+spaces*uSpacesPerChar > 1319)   // if within 1 inch from right stop
+        ww_carriage_return();                       // return to left margin
+    else
+        ww_carrier_right(spaces*uSpacesPerChar);
+}
+
+//-----------------------------------------------------------
+// The correction memory remembers where each character was
+// printed, with its bold and underlining, so that it can be
+// erased later even after the carrier and the paper have moved
+// on. The entries are two bytes:
+//   code | 0x80 if bold,  micro spaces from the character before | 0x80 if underlined
+// where code is the printwheel code, or 0x7F for an underlined
+// space. When a character isn't on the same line as the one
+// before it, or is more than 127 micro spaces to the right of
+// it, it's preceded by a four byte entry:
+//   upper and lower byte of the micro space count of the character before,
+//   0x00, micro lines from the character before (-128 to 127)
+// cmPos and cmLine are the position of the newest character;
+// the entries are read from the newest back to work out the
+// position of each one before it. The oldest entries are
+// overwritten when cmBuf is full.
+//-----------------------------------------------------------
+static void cm_byte(unsigned char b) {
+    cmBuf[cmHead] = b;
+    cmHead = (cmHead+1) & (CMSIZE-1);
+    if (cmUsed < CMSIZE)
+        ++cmUsed;
+}
+
+// remember a character printed at micro space count "pos" on the current line
+static void cm_put(unsigned char code,unsigned char bold,unsigned char underline,unsigned int pos) {
+    int lines;
+
+    if (cmLent)
+        return;
+    lines = uLineCount-cmLine;
+    if (cmUsed && ((lines < -128) || (lines > 127)))
+        cmUsed = 0;                         // too far from the last one, forget the rest
+    if (cmUsed && (lines || (pos < cmPos) || (pos-cmPos > 0x7F))) {
+        cm_byte(cmPos>>8);
+        cm_byte(cmPos&0xFF);
+        cm_byte(0x00);
+        cm_byte(lines);
+        cmPos = pos;
+    }
+    if (!cmUsed)
+        cmPos = pos;
+    cm_byte(code|(bold ? 0x80 : 0));
+    cm_byte((pos-cmPos)|(underline ? 0x80 : 0));
+    cmPos = pos;
+    cmLine = uLineCount;
+}
+
+//-----------------------------------------------------------
+// lends cmBuf (CMSIZE bytes) out, for the values of a form being
+// filled in (see forms.c). what was in the correction memory is
+// forgotten, and what's printed until ww_return_memory() can't
+// be erased.
+//-----------------------------------------------------------
+__xdata unsigned char *ww_lend_memory(void) {
+    cmUsed = 0;
+    cmLent = TRUE;
+    return cmBuf;
+}
+
+void ww_return_memory(void) {
+    cmUsed = 0;
+    cmLent = FALSE;
+}
+
+// strike "code" on the correction tape, where the carrier is
+static void ww_erase_strike(unsigned char code) {
+    ww_put_data(0x121);
+    ww_put_data(0x004);                     // print on correction tape
+    ww_put_data(code);
+    ww_put_data(uSpacesPerChar);            // the carrier doesn't move
+}
+
+//-----------------------------------------------------------
+// Erases the last character printed that hasn't been erased
+// yet, bold and underlining too, even if it's on an earlier
+// line: moves the paper and the carrier back to it and strikes
+// it on the correction tape. Leaves the carrier where the
+// character was, so the next one is printed in its place.
+// Returns FALSE if there's nothing left in the correction
+// memory to erase.
+//-----------------------------------------------------------
+__bit ww_erase_last(void) {
+    unsigned char code,skip;
+    __bit bold,underline;
+    unsigned int pos,line;
+
+    ww_flush();
+    if (cmUsed < 2)
+        return FALSE;
+    cmHead = (cmHead-2) & (CMSIZE-1);       // take the newest character out of the memory
+    cmUsed -= 2;
+    code = cmBuf[cmHead] & 0x7F;
+    bold = (cmBuf[cmHead] & 0x80) != 0;
+    skip = cmBuf[(cmHead+1) & (CMSIZE-1)] & 0x7F;
+    underline = (cmBuf[(cmHead+1) & (CMSIZE-1)] & 0x80) != 0;
+    pos = cmPos;
+    line = cmLine;
+    if (cmUsed >= 2) {                      // work out where the one before it is
+        if (cmBuf[(cmHead-2) & (CMSIZE-1)]) {
+            cmPos = pos-skip;
+        }
+        else if (cmUsed >= 4) {
+            cmLine = line-(signed char)cmBuf[(cmHead-1) & (CMSIZE-1)];
+            cmPos = (cmBuf[(cmHead-4) & (CMSIZE-1)]<<8)|cmBuf[(cmHead-3) & (CMSIZE-1)];
+            cmHead = (cmHead-4) & (CMSIZE-1);
+            cmUsed -= 4;
+        }
+        else
+            cmUsed = 0;                     // the rest has been overwritten
+    }
+
+    amberLED = ON;                          // turn on amber LED
+    ww_paper_move(line-uLineCount);         // paper up or down to the character's line
+    if (pos != uSpaceCount)
+        ww_carrier_move(pos-uSpaceCount);
+    if (underline)
+        ww_erase_strike(0x04F);             // '_' underscore
+    if (code != 0x7F) {
+        ww_erase_strike(code);
+        if (bold) {                         // the second strike, one micro space to the right
+            ww_carrier_move(1);
+            ww_erase_strike(code);
+            ww_carrier_move(-1);
+        }
+    }
+    uSpaceCount = pos;
+    uLineCount = line;
+    amberLED = OFF;                         // turn off amber LED
+    return TRUE;
 }
 
 // paper up one line
 void ww_linefeed(void) {
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.paperMoves;
     ww_put_data(0x121);
     ww_put_data(0x005);                     // vertical movement
     ww_put_data(0x080|uLinesPerLine);       // bit 7 is set to indicate paper up direction, bits 0-4 indicate number of microlines for 1 full line
+    uLineCount += uLinesPerLine;
     amberLED = OFF;                         // turn off amber LED
 }
 
 // paper down one line
 void ww_reverse_linefeed(void) {
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.paperMoves;
     ww_put_data(0x121);
     ww_put_data(0x005);                     // vertical movement
     ww_put_data(0x000|uLinesPerLine);       // bit 7 is cleared to indicate paper down direction, bits 0-4 indicate number of microlines for 1 full line
+    uLineCount -= uLinesPerLine;
     amberLED = OFF;                         // turn off amber LED
 }
 
 // paper up 1/2 line
 void ww_paper_up(void) {
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.paperMoves;
     ww_put_data(0x121);
     ww_put_data(0x005);                     // vertical movement
     ww_put_data(0x080|(uLinesPerLine>>1));  // bit 7 is set to indicate up direction, bits 0-3 indicate number of microlines for 1/2 line
+    uLineCount += uLinesPerLine>>1;
     amberLED = OFF;                         // turn off amber LED
 }
 
 // paper down 1/2 line
 void ww_paper_down(void) {
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.paperMoves;
     ww_put_data(0x121);
     ww_put_data(0x005);                     // vertical movement
     ww_put_data(0x000|(uLinesPerLine>>1));  // bit 7 is cleared to indicate down direction, bits 0-3 indicate number of microlines for 1/2 full line
+    uLineCount -= uLinesPerLine>>1;
     amberLED = OFF;                         // turn off amber LED
 }
 
 // paper up 1/8 line
 void ww_micro_up(void) {
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.paperMoves;
     ww_put_data(0x121);
     ww_put_data(0x005);                     // vertical movement
     ww_put_data(0x080|(uLinesPerLine>>3));  // bit 7 is set to indicate up direction, bits 0-3 indicate number of microlines for 1/8 full line or 1/48"
+    uLineCount += uLinesPerLine>>3;
     amberLED = OFF;                         // turn off amber LED
 }
 
 // paper down 1/8 line
 void ww_micro_down(void) {
+    ww_flush();
     amberLED = ON;                          // turn on amber LED
+    ++stats.paperMoves;
     ww_put_data(0x121);
     ww_put_data(0x005);                     // vertical movement
     ww_put_data(0x000|(uLinesPerLine>>3));  // bit 7 is cleared to indicate down direction, bits 0-3 indicate number of microlines for 1/8 full line or 1/48"
+    uLineCount -= uLinesPerLine>>3;
     amberLED = OFF;                         // turn off amber LED
 }
 
 //-----------------------------------------------------------
 // Sends the code for the letter to be printed the Wheelwriter.
 // Handles bold, continuous and multiple word underline printing.
+// In draft (attribute bit 3) bold is struck once and underlining
+// is left for ww_flush(). With strike ordering (attribute bit 4)
+// the strikes are held back for ww_order_strike() and only the
+// micro space count moves on.
 // Carrier moves to the right by uSpacesPerChar.
 // Increases the micro space count by uSpacesPerChar for each letter printed.
 //-----------------------------------------------------------
 void ww_print_letter(unsigned char letter,unsigned char attribute) {
+     __bit underline;
+
+     underline = (attribute & 0x06) && ((letter!=0x20) || (attribute & 0x02));// if underlining AND the letter is not a space OR continuous underlining is on
+     if (ulCells && (!underline || !(attribute & 0x08) || (attribute & 0x10) || (ulPitch != uSpacesPerChar)))
+        ww_flush();                         // end of the run
+     if (lnOpen && (!(attribute & 0x10) || (lnCount > LNSIZE-3)))
+        ww_flush();                         // strike ordering is off or the buffer is full
+     if (letter != 0x20)
+        ++stats.glyphs;
+     if (ASCII2printwheel[letter-0x20] || underline)// remember it for ww_erase_last()
+        cm_put(ASCII2printwheel[letter-0x20] ? ASCII2printwheel[letter-0x20] : 0x7F,(attribute & 0x09) == 0x01,underline,uSpaceCount);
+     if (attribute & 0x10) {                 // strike ordering
+        if (!lnOpen) {
+            lnOpen = TRUE;
+            lnCarrier = uSpaceCount;        // the carrier stays here until the strikes are made
+        }
+        ww_order_add(ASCII2printwheel[letter-0x20],uSpaceCount);
+        if (underline)
+            ww_order_add(0x04F,uSpaceCount);// '_' underscore in the same place
+        if ((attribute & 0x09) == 0x01)     // bold (not in draft)
+            ww_order_add(ASCII2printwheel[letter-0x20],uSpaceCount+1);// offset by one micro space
+        uSpaceCount += uSpacesPerChar;
+        if (uSpaceCount > 1319)             // if within 1 inch from right stop
+            ww_carriage_return();           // return to left margin
+        return;
+     }
      amberLED = ON;                          // turn on amber LED
+     if (attribute & 0x08) {                 // draft
+        if (underline) {
+            if (!ulCells) {                 // start of a run
+                ulStart = uSpaceCount;
+                ulPitch = uSpacesPerChar;
+            }
+            ++ulCells;
+        }
+        attribute = 0;                      // single strike, no underscore
+     }
      ww_put_data(0x121);
      ww_put_data(0x003);
      ww_put_data(ASCII2printwheel[letter-0x20]);// ascii character (-0x20) as index to printwheel table
-     if ((attribute & 0x06) && ((letter!=0x20) || (attribute & 0x02))){// if underlining AND the letter is not a space OR continuous underlining is on
+     wheelCode = ASCII2printwheel[letter-0x20];
+     if (underline && attribute){             // if underlining (not in draft)
          ww_put_data(0x000);                 // advance zero micro spaces
          ww_put_data(0x121);
          ww_put_data(0x003);
          ww_put_data(0x04F);                 // print '_' underscore
+         wheelCode = 0x04F;
      }
      if (attribute & 0x01) {                 // if the bold bit is set
          ww_put_data(0x001);                 // advance carriage by one micro space
          ww_put_data(0x121);
          ww_put_data(0x003);
          ww_put_data(ASCII2printwheel[letter-0x20]);// re-print the character offset by one micro space
+         wheelCode = ASCII2printwheel[letter-0x20];
          ww_put_data((uSpacesPerChar)-1);    // advance carriage the remaining micro spaces
      }
      else { // not boldprint
@@ -3,15 +3,27 @@
 #ifndef __WHEELWRITER_H__
 #define __WHEELERITER_H__
 
+#ifdef PROFILE
+#define CMSIZE 128                                  // correction memory, bytes (the profiling counters need the room)
+#else
+#define CMSIZE 256                                  // correction memory, bytes (see ww_erase_last())
+#endif
+
 void uart1_isr(void) __interrupt(7) __using(3);
 void ww_print_letter(unsigned char letter,unsigned char attribute);
 void ww_backspace(void);                        
 void ww_micro_backspace(void);
 void ww_space(void);
 void ww_carriage_return(void);
+void ww_carrier_home(void);
 void ww_spin(void);
 void ww_horizontal_tab(unsigned char spaces);
-void ww_erase_letter(unsigned char letter);
+void ww_carrier_right(unsigned int s);
+void ww_move_to(unsigned int pos,unsigned int line);
+__bit ww_erase_last(void);
+__xdata unsigned char *ww_lend_memory(void);
+void ww_return_memory(void);
+void ww_flush(void);
 void ww_linefeed(void);
 void ww_reverse_linefeed(void);
 void ww_paper_up(void);                    
@@ -21,5 +33,7 @@ void ww_micro_down(void);
 void ww_init(void);
 void ww_put_data(unsigned int wwCommand);
 __bit ww_data_avail(void);
+unsigned char ww_data_free(void);
+unsigned char ww_held(void);
 unsigned int ww_get_data(void);
 #endif
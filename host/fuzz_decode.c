@@ -0,0 +1,197 @@
+// fuzz_decode - fuzzing harness for the firmware's input decoders, print_character() (the
+// escape sequences on serial 0) and kb_decode_scancode() (the PS/2 prefixes).
+//
+// usage: fuzz_decode [-r n] [file...]
+//
+//   (libFuzzer) make fuzz, then ./fuzz_decode_lf corpus/
+//   (AFL)       make fuzz_decode CC=afl-gcc, then afl-fuzz -i corpus -o findings ./fuzz_decode @@
+//   file...     run each file once (a crash found by either fuzzer), or stdin without one
+//   -r n        run n random inputs, for a quick look without a fuzzer
+//
+// The first byte of an input picks the decoder: even for serial 0, odd for the PS/2 keyboard.
+// The rest is fed to it one byte at a time. A broken invariant aborts, which both fuzzers
+// report as a crash:
+//
+//   - after the input, EOT returns print_character() to idle (escape == 0) and a Tab scancode
+//     comes out of kb_decode_scancode() within the longest prefix (E1 and its seven bytes)
+//   - column and uSpaceCount stay within the carrier's travel after every byte
+//   - no byte makes the firmware send more than FUZZ_WORDS words on the bus
+//
+// A firmware that waits on the simulated board forever is stopped by hal_poll() (exit 3).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "hal.h"
+#include "hal_sim.h"
+#include "uart12.h"
+#include "keyboard.h"
+#include "keycodes.h"
+#include "wheelwriter.h"
+#include "trace.h"
+#include "config.h"
+#include "sched.h"
+
+#define EOT 0x04
+
+#define FUZZ_WORDS    4096                 // bus words one byte may send (a held back line, a CR and a paper feed)
+#define FUZZ_USPACES  1320+120             // the right stop plus a character at 10 pitch past it
+#define FUZZ_PREFIX   8                    // the longest scancode sequence, pause (E1 14 77 E1 F0 14 F0 77)
+
+// defined in main.c
+void print_character(unsigned char charToPrint);
+void keyboard_key(unsigned char key);
+void task_query(void);
+void task_spool(void);
+void task_form(void);
+void spool_key(unsigned char key);
+extern unsigned char initializing;
+extern unsigned char escape;
+extern unsigned char column;
+extern unsigned char spoolCopies;
+extern unsigned char spoolPaused;
+extern unsigned char form_printing;
+extern unsigned int uSpaceCount;
+
+#define CHECK(cond, what) {                                                          \
+    if (!(cond)) {                                                                   \
+        fprintf(stderr, "fuzz_decode: %s\n", what);                                  \
+        abort();                                                                     \
+    }                                                                                \
+}
+
+static void fuzz_init(void) {
+    static int once = 0;
+
+    if (!once) {                           // the firmware's printf() writes to stdout, discard it
+        dup2(open("/dev/null", O_WRONLY), STDOUT_FILENO);
+        once = 1;
+    }
+    sim_init(NULL, NULL);
+    trace_clear();
+    cfg_load();
+    kb_init();
+    uart_init();
+    ww_init();
+    EA = 1;
+    initializing = 0;
+}
+
+static void fuzz_bounds(unsigned long words) {
+    CHECK(column >= 1, "column left of the margin");
+    CHECK(uSpaceCount <= FUZZ_USPACES, "uSpaceCount past the right stop");
+    CHECK(sim_words_sent-words <= FUZZ_WORDS, "too many bus words for one byte");
+}
+
+// one character through serial 0, as wwsim does it
+static void fuzz_serial(unsigned char c) {
+    unsigned long words = sim_words_sent;
+
+    HAL_WAIT(!RI);
+    SBUF0 = c;
+    RI = 1;
+    hal_poll();
+    if (sched_events & EV_STATUS) {
+        sched_events &= ~EV_STATUS;
+        task_query();
+    }
+    while (uart_char_avail())
+        print_character(uart_getchar());
+    fuzz_bounds(words);
+    while (form_printing || spoolCopies) { // a form or the copies of the spooled job, many words for one byte
+        if (form_printing)
+            task_form();
+        else {
+            if (spoolPaused)
+                spool_key(0);
+            task_spool();
+        }
+        CHECK(uSpaceCount <= FUZZ_USPACES, "uSpaceCount past the right stop");
+    }
+}
+
+// one scancode from the PS/2 keyboard, as kb_isr() and task_keyboard() do it
+static unsigned char fuzz_scancode(unsigned char code) {
+    unsigned long words = sim_words_sent;
+    unsigned char c;
+
+    c = kb_decode_scancode(code);
+    if (c)
+        keyboard_key(c);
+    fuzz_bounds(words);
+    return c;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    size_t i;
+
+    if (!size)
+        return 0;
+    fuzz_init();
+    if (data[0] & 0x01) {
+        for (i=1; i<size; i++)
+            fuzz_scancode(data[i]);
+        for (i=0; (i<FUZZ_PREFIX) && (fuzz_scancode(0x0D) != PS2_KEY_TAB); i++)
+            ;
+        CHECK(i < FUZZ_PREFIX, "kb_decode_scancode() stuck in a prefix");
+    }
+    else {
+        for (i=1; i<size; i++)
+            fuzz_serial(data[i]);
+        fuzz_serial(EOT);
+        CHECK(escape == 0, "print_character() stuck in an escape sequence");
+    }
+    ww_flush();
+    CHECK(uSpaceCount <= FUZZ_USPACES, "uSpaceCount past the right stop");
+    return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+static void run_file(FILE *f) {
+    static unsigned char buf[1 << 16];
+    size_t n;
+
+    n = fread(buf, 1, sizeof(buf), f);
+    LLVMFuzzerTestOneInput(buf, n);
+}
+
+int main(int argc, char *argv[]) {
+    static unsigned char buf[256];
+    static const char text[] = "\x1B\x1A\r\n\t 0123456789aAbcCdefFghHiklmnopqQrRsStTuUvwxyz";
+    unsigned long runs = 0, r;
+    FILE *f;
+    int opt, i, n;
+
+    while ((opt = getopt(argc, argv, "r:")) != -1) {
+        switch (opt) {
+            case 'r': runs = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "usage: fuzz_decode [-r n] [file...]\n");
+                return 2;
+        }
+    }
+    for (r=0; r<runs; r++) {
+        srand(r);
+        n = 1+rand() % sizeof(buf);
+        for (i=0; i<n; i++)                // mostly printable text and escapes, some of anything
+            buf[i] = (rand() & 3) ? text[rand() % (sizeof(text)-1)] : rand();
+        LLVMFuzzerTestOneInput(buf, n);
+    }
+    if (!runs && optind == argc)
+        run_file(stdin);
+    for (i=optind; i<argc; i++) {
+        if (!(f = fopen(argv[i], "rb"))) {
+            perror(argv[i]);
+            return 1;
+        }
+        run_file(f);
+        fclose(f);
+    }
+    return 0;
+}
+
+#endif
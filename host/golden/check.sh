@@ -0,0 +1,35 @@
+#!/bin/sh
+# Runs wwsim over each case in golden/cases and compares the bus words and the -c counts with
+# the recorded trace, golden/<name>.out. A difference is shown with the counts before and
+# after, so that an optimization of the command stream shows both that it changed and by how
+# many words. With -u the traces are recorded again (after a change that is meant to alter them).
+#
+# usage: sh golden/check.sh [-u]     (from the host folder, or 'make check' / 'make golden')
+
+cd "$(dirname "$0")" || exit 2
+update=0
+[ "$1" = "-u" ] && update=1
+tmp=$(mktemp) || exit 2
+trap 'rm -f "$tmp"' EXIT
+
+grep -v '^#' cases | {
+    failed=0
+    while read -r name input opts; do
+        [ -n "$name" ] || continue
+        if ! ../wwsim -q -c $opts "$input" >"$tmp" 2>&1; then
+            echo "$name: wwsim failed"
+            failed=1
+        elif [ $update = 1 ]; then
+            cp "$tmp" "$name.out"
+            echo "$name: recorded, $(tail -n 1 "$tmp")"
+        elif ! cmp -s "$tmp" "$name.out"; then
+            echo "$name: differs"
+            echo "  was $(tail -n 1 "$name.out")"
+            echo "  now $(tail -n 1 "$tmp")"
+            diff "$name.out" "$tmp" | head -n 20
+            failed=1
+        fi
+    done
+    [ $failed = 0 ] && [ $update = 0 ] && echo "all traces match"
+    exit $failed
+}
@@ -0,0 +1,123 @@
+// Simulated DS89C440 board for the host-native build.
+//
+// The SFRs and pins are plain variables. hal_poll() stands in for the hardware between two
+// looks at a flag the firmware is spinning on: it runs the serial interrupt service routines
+// when their flags are set and plays the Printer Board's side of the bus handshake, which
+// answers every word with an all-zeros acknowledge.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal.h"
+#include "hal_sim.h"
+#include "uart12.h"
+#include "wheelwriter.h"
+
+volatile unsigned char P0 = 0xFF, P1 = 0xFF, P2 = 0xFF, P3 = 0xFF, PCON, TCON, TMOD, TL0, TH0, TL1, TH1,
+                       CKCON, CKMOD, SCON0, SBUF0, SCON1, SBUF1, IE, PMR, TA, FCNTL, FDATA, WDCON, EXIF,
+                       T2CON, TH2, TL2, RCAP2H, RCAP2L;
+
+volatile unsigned char IT0, IE0, IT1, IE1, TR0, TF0, TR1, TF1,
+                       RI, TI, REN, ES0, ET0, EX0, EX1, ES1, EA,
+                       RI1, TI1, RB81, TB8_1, REN1, SM01, SM11, SM21,
+                       RWT, EWT, WTRF, POR, SMOD_1, TR2;
+
+volatile unsigned char switch1 = 1, switch2 = 1, switch3 = 1, switch4 = 1,
+                       redLED = 1, amberLED = 1, greenLED = 1,
+                       ackPin = 1, busyPin = 0, WWbus = 1,
+                       strobePin = 1, selectInPin = 0, autoFdPin = 1, pePin = 0, selectPin = 1, faultPin = 1,
+                       kb_clock_out = 1, kb_data_out = 1, kb_data_in = 1, kb_clock_in = 1,
+                       CTS = 0, RTS = 0;
+
+#define HANG_POLLS 1000000UL                   // polls without progress before giving up
+
+static FILE *bus_out;                          // words sent to the Printer Board
+static FILE *console_out;                      // characters sent out through serial 0
+static unsigned char ack_phase;                // 1: acknowledge due, 2: bus returning high
+static unsigned long idle_polls;
+
+unsigned long sim_words_sent;                  // words sent to the Printer Board
+unsigned long sim_commands[SIM_COMMANDS];      // commands sent, by the word following 0x121
+static unsigned int last_word;
+
+#define FLASH_SIZE      0x8000                 // 32K of flash on the DS89C440
+#define FLASH_PAGESIZE  512
+static unsigned char flash[FLASH_SIZE];        // erased (all ones) at start up
+
+void sim_init(FILE *bus, FILE *console) {
+    bus_out = bus;
+    console_out = console;
+    ack_phase = 0;
+    idle_polls = 0;
+    sim_words_sent = 0;
+    memset(sim_commands, 0, sizeof(sim_commands));
+    last_word = 0;
+    memset(flash, 0xFF, sizeof(flash));
+}
+
+void hal_poll(void) {
+    if ((TI || RI) && ES0) {                   // serial 0 interrupt
+        uart0_isr();
+    }
+    else if ((TI1 || RI1) && ES1) {            // serial 1 interrupt
+        uart1_isr();
+    }
+    else if (ack_phase == 1) {                 // Printer Board pulls the bus low: acknowledge
+        WWbus = 0;
+        SBUF1 = 0x00;
+        RB81 = 0;
+        RI1 = 1;
+        ack_phase = 2;
+    }
+    else if (ack_phase == 2) {                 // end of the acknowledge
+        WWbus = 1;
+        ack_phase = 0;
+    }
+    else if (++idle_polls > HANG_POLLS) {
+        fprintf(stderr, "wwsim: firmware is waiting on hardware that will never respond\n");
+        exit(3);
+    }
+    else {
+        return;
+    }
+    idle_polls = 0;
+}
+
+void hal_uart0_tx(unsigned char c) {
+    if (console_out)
+        fputc(c, console_out);
+    TI = 1;                                    // transmission finishes at once
+}
+
+void hal_ww_tx(unsigned int w) {
+    ++sim_words_sent;
+    if (last_word == 0x121 && w < SIM_COMMANDS)
+        ++sim_commands[w];
+    last_word = w;
+    if (bus_out)
+        fprintf(bus_out, "%03X\n", w & 0x1FF);
+    TI1 = 1;                                   // transmission finishes at once...
+    ack_phase = 1;                             // ...and the Printer Board acknowledges it
+}
+
+unsigned char hal_flash_read(unsigned int addr) {
+    return flash[addr % FLASH_SIZE];
+}
+
+// programming can only clear bits; erasing sets a whole page back to ones
+void hal_flash_cmd(unsigned char cmd, unsigned int addr, unsigned char data) {
+    addr %= FLASH_SIZE;
+    if (cmd == FLASH_PROGRAM)
+        flash[addr] &= data;
+    else if (cmd == FLASH_ERASE)
+        memset(&flash[addr & ~(FLASH_PAGESIZE - 1)], 0xFF, FLASH_PAGESIZE);
+}
+
+// put one word on the bus as if it were sent by the Function Board
+void sim_bus_receive(unsigned int w) {
+    HAL_WAIT(!RI1);
+    SBUF1 = w & 0xFF;
+    RB81 = (w >> 8) & 0x01;
+    RI1 = 1;
+    hal_poll();
+}
@@ -0,0 +1,66 @@
+// Hardware abstraction layer for the host-native build (gcc on Linux).
+//
+// Included by ../SDCC/hal.h when the firmware is compiled by anything other than SDCC. The
+// SDCC storage class and interrupt keywords are defined away, every SFR, bit and pin used by
+// the firmware becomes an ordinary variable (defined in hal_host.c), and the few hardware
+// operations in hal.h call into a simulated Printer Board that acknowledges each word.
+
+#ifndef __HAL_HOST_H__
+#define __HAL_HOST_H__
+
+#define __data
+#define __idata
+#define __xdata
+#define __code
+#define __at(addr)
+#define __interrupt(n)
+#define __using(n)
+#define __critical
+#define __bit unsigned char
+
+// SFRs
+extern volatile unsigned char P0, P1, P2, P3, PCON, TCON, TMOD, TL0, TH0, TL1, TH1, CKCON, CKMOD,
+                              SCON0, SBUF0, SCON1, SBUF1, IE, PMR, TA, FCNTL, FDATA, WDCON, EXIF,
+                              T2CON, TH2, TL2, RCAP2H, RCAP2L;
+
+// SFR bits
+extern volatile unsigned char IT0, IE0, IT1, IE1, TR0, TF0, TR1, TF1,
+                              RI, TI, REN, ES0, ET0, EX0, EX1, ES1, EA,
+                              RI1, TI1, RB81, TB8_1, REN1, SM01, SM11, SM21,
+                              RWT, EWT, WTRF, POR, SMOD_1, TR2;
+
+// pins (see hal.h for the assignments on the real board)
+extern volatile unsigned char switch1, switch2, switch3, switch4,
+                              redLED, amberLED, greenLED,
+                              ackPin, busyPin, WWbus,
+                              strobePin, selectInPin, autoFdPin, pePin, selectPin, faultPin,
+                              kb_clock_out, kb_data_out, kb_data_in, kb_clock_in,
+                              CTS, RTS;
+
+#define NOP()
+
+// spin until 'cond' becomes true, letting the simulated hardware run meanwhile
+#define HAL_WAIT(cond) while (!(cond)) hal_poll()
+
+#define HAL_UART0_TX(c) hal_uart0_tx(c)
+#define HAL_WW_TX(w) hal_ww_tx(w)
+#define HAL_WW_WAIT_ACK() {                                                          \
+    HAL_WAIT(WWbus);                                                                 \
+    HAL_WAIT(!WWbus);                                                                \
+    HAL_WAIT(WWbus);                                                                 \
+}
+#define HAL_WW_RX(lo,ninth) {                                                        \
+    lo = SBUF1;                                                                      \
+    ninth = RB81;                                                                    \
+}
+
+#define HAL_FLASH_READ(a) hal_flash_read(a)
+#define HAL_FLASH_CMD(cmd,a,d) hal_flash_cmd(cmd,a,d)
+
+void hal_poll(void);
+void hal_uart0_tx(unsigned char c);
+void hal_ww_tx(unsigned int w);
+unsigned char hal_flash_read(unsigned int addr);
+void hal_flash_cmd(unsigned char cmd, unsigned int addr, unsigned char data);
+
+#endif
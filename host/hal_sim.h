@@ -0,0 +1,16 @@
+// Simulated board controls used by the host-native tools.
+
+#ifndef __HAL_SIM_H__
+#define __HAL_SIM_H__
+
+#include <stdio.h>
+
+#define SIM_COMMANDS 8                          // commands 0x121,0x000 through 0x121,0x007
+
+extern unsigned long sim_words_sent;
+extern unsigned long sim_commands[SIM_COMMANDS];
+
+void sim_init(FILE *bus, FILE *console);
+void sim_bus_receive(unsigned int w);
+
+#endif
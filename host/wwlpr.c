@@ -0,0 +1,447 @@
+// wwlpr - prints text on the Wheelwriter, laid out on the host in as few bytes as the firmware allows.
+//
+// usage: wwlpr [-p cpi] [-l lines] [-a] [-d device] [-s bps] [file]
+//        wwlpr job user title copies options [file]        (as a CUPS filter)
+//
+//   -p cpi    pitch, 10 (Pica), 12 (Elite) or 15 (Micro Elite, 8 lines per inch); without it the
+//             printer keeps the pitch of its printwheel, asked for with ENQ on a serial port
+//   -l lines  lines per page, where a form feed goes to (66, or 88 at 15 cpi)
+//   -a        dip switch 1 is on (auto linefeed with carriage return)
+//   -d device the serial port the printer is on; without it the stream goes to stdout
+//   -s bps    the port's bit rate, 2400, 4800, 9600 (the default) or 19200
+//
+// The text is laid out a page at a time: tabs every 8 columns, backspaces, form feeds, and
+// the half line moves of nroff (<ESC>7, <ESC>8 and <ESC>9). A character struck twice is
+// printed bold, one struck with an underscore underlined. Each line then goes to the printer
+// from wherever the last one left the carrier: the paper moves with LF and half line feeds,
+// the carrier moves to the first character with tabs to the firmware's tab stops and only then
+// spaces, and a line that starts to the right of the carrier needs no carriage return. Spaces
+// at the ends of lines and blank lines at the end of the document aren't sent.
+//
+// On a serial port the stream is paced by RTS/CTS, ends with EOT, and then ENQ asks for the
+// status until it says done=1, so that the characters per second reported cover the printing
+// and not just the sending. As a CUPS filter the stream goes to stdout for the backend (give
+// the serial backend flow=hard), with the pitch taken from the cpi option. Where the pitch
+// isn't known, the carrier is moved with spaces only, since the tab stops go with the pitch.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/select.h>
+
+#define EOT 0x04
+#define ENQ 0x05
+#define BS  0x08
+#define HT  0x09
+#define LF  0x0A
+#define FF  0x0C
+#define CR  0x0D
+#define ESC 0x1B
+
+#define MAXCOLS 256
+#define MAXHALF 400                         // half lines on a page, up to 200 lines
+
+#define BOLD  0x01
+#define UNDER 0x02
+
+typedef struct {
+    unsigned char c;                        // the character, 0 where nothing is printed
+    unsigned char attr;                     // BOLD, UNDER
+} cell_t;
+
+static cell_t page[MAXHALF][MAXCOLS];
+static int pageHalf = 132;                  // half lines per page
+static int tabStop = 5;                     // the firmware's tab stops for the pitch (see <ESC><p>), 0 if it isn't known
+static int autoLF;                          // dip switch 1 on, CR moves the paper up a line too
+
+// where the stream leaves the printer
+static int prow;                            // half lines from the top of the page
+static int pcol = 1;                        // column, 1 is the left margin
+static int pattr;                           // BOLD, UNDER
+
+static FILE *out;
+static unsigned long sent, glyphs;          // bytes sent, characters printed
+
+static void usage(void) {
+    fprintf(stderr, "usage: wwlpr [-p cpi] [-l lines] [-a] [-d device] [-s bps] [file]\n"
+                    "       wwlpr job user title copies options [file]\n");
+    exit(2);
+}
+
+static void put(int c) {
+    fputc(c, out);
+    ++sent;
+}
+
+static void put_esc(int c) {
+    put(ESC);
+    put(c);
+}
+
+// bold and underlining as 'attr' wants them
+static void set_attr(int attr) {
+    if ((pattr & BOLD) && !(attr & BOLD))
+        put_esc('&');
+    if ((pattr & UNDER) && !(attr & UNDER))
+        put_esc('R');                       // (leaves bold alone)
+    if (!(pattr & BOLD) && (attr & BOLD))
+        put_esc('O');
+    if (!(pattr & UNDER) && (attr & UNDER))
+        put_esc('E');
+    pattr = attr;
+}
+
+// back to the left margin, which also cancels bold and underlining
+static void carriage_return(void) {
+    put(CR);
+    pcol = 1;
+    pattr = 0;
+    if (autoLF)
+        prow += 2;
+}
+
+// paper to half line 'row', up with LF and <ESC><U> or down with <ESC><LF> and <ESC><D>
+static void paper_to(int row) {
+    for (; row-prow >= 2; prow += 2)
+        put(LF);
+    if (row-prow == 1) {
+        put_esc('U');
+        ++prow;
+    }
+    for (; prow-row >= 2; prow -= 2)
+        put_esc(LF);
+    if (prow-row == 1) {
+        put_esc('D');
+        --prow;
+    }
+}
+
+// carrier right to column 'col', to the tab stops first (as the firmware works them out) and then spaces
+static void carrier_to(int col) {
+    int next;
+
+    set_attr(pattr & ~UNDER);               // the gap isn't underlined
+    while (tabStop && (next = pcol+tabStop-(pcol%tabStop)) <= col) {
+        put(HT);
+        pcol = next;
+    }
+    for (; pcol < col; pcol++)
+        put(' ');
+}
+
+static void send_row(int r) {
+    cell_t *cell = page[r];
+    int first, last, col;
+
+    for (last = MAXCOLS; (last > 0) && !cell[last-1].c; last--)
+        ;
+    if (!last)
+        return;
+    for (first = 0; !cell[first].c; first++)
+        ;
+    if (first+1 < pcol)                     // the carrier has gone past the start of the line
+        carriage_return();
+    paper_to(r);
+    for (col = first; col < last; col++) {
+        if (!cell[col].c)
+            continue;
+        if (pcol != col+1)
+            carrier_to(col+1);
+        set_attr(cell[col].attr);
+        put(cell[col].c);
+        ++glyphs;
+        ++pcol;
+    }
+}
+
+// send the page laid out so far. 'eject' feeds the paper to the top of the next page.
+static void send_page(int eject) {
+    int r;
+
+    for (r = 0; r < pageHalf; r++)
+        send_row(r);
+    if (eject) {
+        if (pcol > 1)
+            carriage_return();
+        paper_to(pageHalf);
+        prow -= pageHalf;
+    }
+    else if (pcol > 1) {                    // the end of the document, leave the carrier on a new line
+        carriage_return();
+        if (!autoLF)
+            put(LF);
+    }
+    memset(page, 0, sizeof(page));
+}
+
+// strike 'c' at half line 'row', column 'col' of the page
+static void strike(int row, int col, int c) {
+    cell_t *cell;
+
+    if (col >= MAXCOLS)
+        return;
+    cell = &page[row][col];
+    if ((c == '_') && cell->c && (cell->c != '_'))
+        cell->attr |= UNDER;                // underscore over a character
+    else if ((cell->c == '_') && (c != '_')) {
+        cell->c = c;                        // a character over an underscore
+        cell->attr |= UNDER;
+    }
+    else if (cell->c == c)
+        cell->attr |= BOLD;                 // struck twice
+    else
+        cell->c = c;
+}
+
+// lay out the document and send it
+static void layout(const unsigned char *text, size_t n) {
+    size_t i;
+    int c, row = 0, col = 0;
+
+    for (i = 0; i < n; i++) {
+        c = text[i];
+        switch (c) {
+            case LF:
+                row += 2;
+                col = 0;
+                break;
+            case CR:
+                col = 0;
+                break;
+            case HT:
+                col = (col/8+1)*8;
+                break;
+            case BS:
+                if (col)
+                    --col;
+                break;
+            case FF:
+                send_page(1);
+                row = col = 0;
+                break;
+            case ESC:                       // nroff's reverse line feed and half line moves
+                if (++i == n)
+                    break;
+                if (text[i] == '7')
+                    row -= 2;
+                else if (text[i] == '8')
+                    row -= 1;
+                else if (text[i] == '9')
+                    row += 1;
+                if (row < 0)
+                    row = 0;
+                break;
+            default:
+                if ((c < ' ') || (c > '~'))
+                    break;
+                if (row >= pageHalf) {      // off the bottom of the page without a form feed
+                    send_page(1);
+                    row %= pageHalf;
+                }
+                if (c != ' ')
+                    strike(row, col, c);
+                ++col;
+        }
+    }
+    send_page(0);
+}
+
+static int open_port(const char *device, int bps) {
+    struct termios t;
+    speed_t speed;
+    int fd;
+
+    switch (bps) {
+        case 2400:  speed = B2400; break;
+        case 4800:  speed = B4800; break;
+        case 9600:  speed = B9600; break;
+        case 19200: speed = B19200; break;
+        default:
+            fprintf(stderr, "wwlpr: the printer runs at 2400, 4800, 9600 or 19200 bps\n");
+            exit(2);
+    }
+    if ((fd = open(device, O_RDWR | O_NOCTTY)) < 0 || tcgetattr(fd, &t) < 0) {
+        perror(device);
+        exit(1);
+    }
+    cfmakeraw(&t);
+    cfsetispeed(&t, speed);
+    cfsetospeed(&t, speed);
+    t.c_cflag |= CRTSCTS | CLOCAL | CREAD;  // the firmware holds RTS while its receive buffer is full
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    if (tcsetattr(fd, TCSANOW, &t) < 0) {
+        perror(device);
+        exit(1);
+    }
+    return fd;
+}
+
+// ask for the status (ENQ) and listen for half a second. the STATUS line goes in 'status'.
+// FALSE if there was none.
+static int get_status(int fd, char *status, size_t size) {
+    char line[256], c;
+    size_t n = 0;
+    int answered = 0;
+    struct timeval tv;
+    fd_set fds;
+
+    c = ENQ;
+    if (write(fd, &c, 1) != 1)
+        return 0;
+    tv.tv_sec = 0;
+    tv.tv_usec = 500000;
+    FD_ZERO(&fds);
+    FD_SET(fd, &fds);
+    while (select(fd+1, &fds, NULL, NULL, &tv) > 0 && read(fd, &c, 1) == 1) {
+        if ((c != '\n') && (n < sizeof(line)-1)) {
+            line[n++] = c;
+            continue;
+        }
+        line[n] = 0;
+        n = 0;
+        if (strstr(line, "STATUS ")) {
+            snprintf(status, size, "%s", line);
+            answered = 1;
+        }
+    }
+    return answered;
+}
+
+// ask for the status every half second until it says done=1. FALSE if the printer stops
+// answering for 10 seconds.
+static int wait_done(int fd) {
+    char status[256];
+    int quiet = 0;
+
+    tcflush(fd, TCIFLUSH);                  // the echo of the characters printed so far
+    while (quiet < 20) {
+        if (!get_status(fd, status, sizeof(status)))
+            ++quiet;
+        else if (strstr(status, " done=1"))
+            return 1;
+        else
+            quiet = 0;
+    }
+    return 0;
+}
+
+// the pitch of the printwheel the printer reports (wheel= in the status), 0 if it doesn't answer
+static int wheel_pitch(int fd) {
+    char status[256], *w;
+
+    tcflush(fd, TCIFLUSH);
+    if (!get_status(fd, status, sizeof(status)) || !(w = strstr(status, " wheel=")))
+        return 0;
+    switch (strtol(w+7, NULL, 16)) {
+        case 0x10: return 15;               // 15P
+        case 0x40: return 10;               // 10P
+        default:   return 12;               // 12P and PS, or the firmware's pitch when it can't tell
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *in = stdin;
+    const char *device = NULL, *file = NULL, *opt;
+    unsigned char *text = NULL;
+    size_t n = 0, size = 0;
+    int cpi = 0, pitch, lines = 0, bps = 9600, copies = 1, filter = 0, fd = -1, done, c;
+    double start, seconds;
+
+    if ((argc == 6 || argc == 7) && isdigit((unsigned char)argv[1][0])) {
+        filter = 1;                         // job user title copies options [file]
+        copies = atoi(argv[4]);
+        if ((opt = strstr(argv[5], "cpi=")))
+            cpi = atoi(opt+4);
+        if (argc == 7)
+            file = argv[6];
+    }
+    else {
+        while ((c = getopt(argc, argv, "p:l:ad:s:")) != -1) {
+            switch (c) {
+                case 'p': cpi = atoi(optarg); break;
+                case 'l': lines = atoi(optarg); break;
+                case 'a': autoLF = 1; break;
+                case 'd': device = optarg; break;
+                case 's': bps = atoi(optarg); break;
+                default: usage();
+            }
+        }
+        if (optind < argc)
+            file = argv[optind];
+    }
+    if (file && !(in = fopen(file, "rb"))) {
+        perror(file);
+        return 1;
+    }
+    do {                                    // the whole document, it's sent once for each copy
+        if (n == size && !(text = realloc(text, size = size ? size*2 : 65536))) {
+            perror("wwlpr");
+            return 1;
+        }
+        n += fread(text+n, 1, size-n, in);
+    } while (n == size);
+
+    if (device) {
+        fd = open_port(device, bps);
+        out = fdopen(fd, "w");
+    }
+    else
+        out = stdout;
+
+    pitch = cpi;                            // only a pitch asked for is sent, the printwheel's stays otherwise
+    if (!cpi && device)
+        cpi = wheel_pitch(fd);
+    switch (cpi) {
+        case 0:  tabStop = 0; break;        // not known, no tabs
+        case 10: tabStop = 5; break;
+        case 12: tabStop = 6; break;
+        case 15: tabStop = 7; break;
+        default:
+            fprintf(stderr, "wwlpr: the pitch is 10, 12 or 15 cpi\n");
+            return 2;
+    }
+    if (!lines)
+        lines = (cpi == 15) ? 88 : 66;
+    if (lines < 1 || lines > MAXHALF/2) {
+        fprintf(stderr, "wwlpr: 1 to %d lines per page\n", MAXHALF/2);
+        return 2;
+    }
+    pageHalf = lines*2;
+
+    start = now();
+    if (pitch)
+        put_esc((pitch == 10) ? 'p' : (pitch == 12) ? 'e' : 'm');
+    while (copies-- > 0)
+        layout(text, n);
+    put(EOT);                               // end of job
+    fflush(out);
+
+    if (filter) {
+        fprintf(stderr, "INFO: %lu characters in %lu bytes (%lu in the document)\n", glyphs, sent, (unsigned long)n);
+        return 0;
+    }
+    if (!device) {
+        fprintf(stderr, "wwlpr: %lu characters in %lu bytes (%lu in the document)\n", glyphs, sent, (unsigned long)n);
+        return 0;
+    }
+    tcdrain(fd);
+    done = wait_done(fd);
+    seconds = now()-start;
+    fprintf(stderr, "wwlpr: %lu characters in %lu bytes (%lu in the document), %.1f seconds, %.1f characters per second%s\n",
+            glyphs, sent, (unsigned long)n, seconds, seconds > 0 ? glyphs/seconds : 0.0,
+            done ? "" : " (no answer from the printer, sent but maybe not printed)");
+    return !done;
+}
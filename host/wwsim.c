@@ -0,0 +1,143 @@
+// wwsim - runs the printer firmware on the build machine against a simulated Printer Board.
+//
+// usage: wwsim [-k | -b] [-a] [-d] [-t n] [-p] [-c] [-q] [file]
+//
+//   (default) the input bytes arrive through serial 0 and are printed by print_character()
+//   -k        the input is PS/2 scancodes in hex, decoded by kb_decode_scancode() and keyboard_key()
+//   -b        the input is 9 bit words in hex sent by the Function Board, decoded by parseWWdata()
+//   -a        dip switch 1 on (auto linefeed with carriage return)
+//   -d        dip switch 3 on (draft printing)
+//   -t n      terminal mode, 1 raw or 2 cooked; with -b the keys sent to the host go to stderr
+//   -p        the PS/2 keyboard's keys go to the host; with -k they go to stderr
+//   -c        finish with a one line count of the words and commands sent, on stderr
+//   -q        discard the console output
+//
+// The words the firmware sends to the Printer Board are written to stdout, three hex digits
+// per line. The console output (serial 0) goes to stderr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include "hal.h"
+#include "hal_sim.h"
+#include "uart12.h"
+#include "keyboard.h"
+#include "wheelwriter.h"
+#include "trace.h"
+#include "config.h"
+#include "sched.h"
+
+// defined in main.c
+void print_character(unsigned char charToPrint);
+void parseWWdata(unsigned int WWdata);
+void keyboard_key(unsigned char key);
+void task_query(void);
+void task_spool(void);
+void task_form(void);
+void spool_key(unsigned char key);
+extern unsigned char initializing;
+extern unsigned char spoolCopies;
+extern unsigned char spoolPaused;
+extern unsigned char form_printing;
+
+static void usage(void) {
+    fprintf(stderr, "usage: wwsim [-k | -b] [-a] [-d] [-t n] [-p] [-c] [-q] [file]\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    FILE *in = stdin;
+    FILE *bus;
+    int mode = 0, quiet = 0, counts = 0, tty = 0, kbhost = 0, opt, c;
+    unsigned int word;
+
+    while ((opt = getopt(argc, argv, "kbadt:pcq")) != -1) {
+        switch (opt) {
+            case 'k': mode = 'k'; break;
+            case 'b': mode = 'b'; break;
+            case 'a': switch1 = 0; break;
+            case 'd': switch3 = 0; break;
+            case 't': tty = atoi(optarg); break;
+            case 'p': kbhost = 1; break;
+            case 'c': counts = 1; break;
+            case 'q': quiet = 1; break;
+            default: usage();
+        }
+    }
+    if (optind < argc && !(in = fopen(argv[optind], "rb"))) {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    // the firmware's printf() writes to stdout; keep stdout for the bus words and
+    // send the firmware's console output to stderr (or nowhere)
+    bus = fdopen(dup(STDOUT_FILENO), "w");
+    dup2(quiet ? open("/dev/null", O_WRONLY) : STDERR_FILENO, STDOUT_FILENO);
+    setvbuf(stdout, NULL, _IONBF, 0);
+    sim_init(bus, stdout);
+
+    trace_clear();
+    cfg_load();                            // the simulated flash is erased, so these are the defaults
+    if (tty == 1)
+        cfg.options |= CFG_TTY_RAW;
+    else if (tty == 2)
+        cfg.options |= CFG_TTY_COOKED;
+    if (kbhost)
+        cfg.options |= CFG_KBHOST;
+    kb_init();
+    uart_init();
+    ww_init();
+    EA = 1;
+    initializing = 0;                      // as main() leaves it once the Wheelwriter has answered
+
+    switch (mode) {
+        case 'k':
+            while (fscanf(in, "%x", &word) == 1) {
+                c = kb_decode_scancode(word & 0xFF);
+                if (c)
+                    keyboard_key(c);
+            }
+            break;
+        case 'b':
+            while (fscanf(in, "%x", &word) == 1) {
+                sim_bus_receive(word);
+                while (ww_data_avail())
+                    parseWWdata(ww_get_data());
+            }
+            break;
+        default:
+            while ((c = fgetc(in)) != EOF) {
+                HAL_WAIT(!RI);
+                SBUF0 = c;                         // character arrives on serial 0
+                RI = 1;
+                hal_poll();
+                if (sched_events & EV_STATUS) {    // ENQ, answered ahead of the characters waiting
+                    sched_events &= ~EV_STATUS;
+                    task_query();
+                }
+                while (uart_char_avail())
+                    print_character(uart_getchar());
+                while (form_printing || spoolCopies) {
+                    if (form_printing)             // <ESC><f><n>
+                        task_form();
+                    else {                         // <ESC><c><n>, the paper is changed at once
+                        if (spoolPaused)
+                            spool_key(0);
+                        task_spool();
+                    }
+                }
+            }
+    }
+
+    ww_flush();                            // the main loop does this when the job is over
+    uart_flush();                          // the console output still in the transmit buffer
+    fflush(bus);
+    fprintf(stderr, quiet ? "" : "\n");
+    if (counts)
+        fprintf(stderr, "words %lu print %lu erase %lu carrier %lu paper %lu spin %lu query %lu\n",
+                sim_words_sent, sim_commands[0x003], sim_commands[0x004], sim_commands[0x006],
+                sim_commands[0x005], sim_commands[0x007], sim_commands[0x001]);
+    return 0;
+}
@@ -0,0 +1,219 @@
+// wwtime - predicts how long the Wheelwriter takes to carry out a stream of bus commands.
+//
+// usage: wwtime [-v] [-s name=value]... [file]
+//
+// Reads the 9 bit words sent to the Printer Board, three hex digits per word separated by
+// white space (the output of wwsim or a capture of the BUS), replays them through a timing
+// model of the mechanism and reports the predicted time, where it goes, and the time per
+// page. -v lists every command with its predicted time. -s overrides a model parameter;
+// run with -s help to list the parameters and their values.
+//
+// The model: a glyph strike first rotates the printwheel the shorter way round to the new
+// character, which overlaps the carrier's move from the previous strike, then fires the
+// hammer. Carrier and paper moves take a fixed start/stop time plus a time per microspace or
+// microline. Every word costs its bus time including the acknowledge. The model is not
+// calibrated: the default parameters are guesses that have not been checked against a
+// Wheelwriter. Time a few known documents with a stopwatch and adjust them with -s before
+// trusting the absolute times; comparisons between two streams are less sensitive to them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WHEELPOSITIONS 96                   // characters on the printwheel
+
+typedef struct {
+    const char *name;
+    double value;
+    const char *help;
+} param_t;
+
+static param_t params[] = {
+    {"word_ms",       0.10,  "bus time per word including the acknowledge"},
+    {"strike_ms",    28.0,   "hammer strike and ribbon lift"},
+    {"erase_ms",     40.0,   "strike on the correction tape"},
+    {"wheel_ms",      0.55,  "printwheel rotation per position"},
+    {"wheel_settle", 4.0,    "printwheel settling time after a rotation"},
+    {"carrier_ms",    0.22,  "carrier travel per microspace (1/120 inch)"},
+    {"carrier_start", 6.0,   "carrier start/stop time for a move"},
+    {"paper_ms",      1.2,   "paper feed per microline"},
+    {"paper_start",  12.0,   "paper feed start/stop time"},
+    {"spin_ms",     600.0,   "printwheel spin"},
+    {"page_lines",   66.0,   "lines per page (11 inches at 6 lines per inch)"},
+    {"line_ulines",  16.0,   "microlines per line"},
+    {NULL, 0, NULL}
+};
+
+enum {T_BUS, T_STRIKE, T_WHEEL, T_CARRIER, T_PAPER, T_SPIN, T_CATEGORIES};
+static const char *category[T_CATEGORIES] = {"bus", "strike", "wheel", "carrier", "paper", "spin"};
+
+static double spent[T_CATEGORIES];          // seconds per category
+static unsigned long strikes, erases, carrierMoves, paperMoves, spins, words;
+static unsigned long paperUp;               // microlines the paper moved up
+static int wheelPos = 1;                    // printwheel position under the hammer
+static double pendingCarrier;               // carrier travel that can overlap the next rotation
+static int verbose;
+
+static double param(const char *name) {
+    param_t *p;
+
+    for (p = params; p->name; p++)
+        if (!strcmp(p->name, name))
+            return p->value;
+    fprintf(stderr, "wwtime: unknown parameter %s\n", name);
+    exit(2);
+}
+
+static void set_param(const char *arg) {
+    param_t *p;
+    const char *eq = strchr(arg, '=');
+
+    if (!eq) {
+        for (p = params; p->name; p++)
+            fprintf(stderr, "  %-14s %8.2f  %s\n", p->name, p->value, p->help);
+        exit(2);
+    }
+    for (p = params; p->name; p++) {
+        if (!strncmp(p->name, arg, eq - arg) && p->name[eq - arg] == '\0') {
+            p->value = atof(eq + 1);
+            return;
+        }
+    }
+    fprintf(stderr, "wwtime: unknown parameter %.*s\n", (int)(eq - arg), arg);
+    exit(2);
+}
+
+// time for the carrier to move 'uspaces' microspaces
+static double carrier_time(unsigned int uspaces) {
+    return uspaces ? (param("carrier_start") + uspaces * param("carrier_ms")) / 1000.0 : 0.0;
+}
+
+// flush carrier travel that was not hidden behind a printwheel rotation
+static void settle_carrier(void) {
+    spent[T_CARRIER] += pendingCarrier;
+    pendingCarrier = 0.0;
+}
+
+// rotate the printwheel to 'code' and strike it
+static double strike(int code, int category_, double strike_ms) {
+    int d = abs(code - wheelPos);
+    double rotate;
+
+    if (d > WHEELPOSITIONS / 2)
+        d = WHEELPOSITIONS - d;                                 // the shorter way round
+    rotate = d ? (d * param("wheel_ms") + param("wheel_settle")) / 1000.0 : 0.0;
+    wheelPos = code;
+    if (rotate > pendingCarrier) {                              // rotation hides the carrier move
+        spent[T_WHEEL] += rotate - pendingCarrier;
+        spent[T_CARRIER] += pendingCarrier;
+    }
+    else {
+        spent[T_CARRIER] += pendingCarrier;
+    }
+    pendingCarrier = 0.0;
+    spent[category_] += strike_ms / 1000.0;
+    return rotate + strike_ms / 1000.0;
+}
+
+static int next_word(FILE *in, unsigned int *w) {
+    if (fscanf(in, "%x", w) != 1)
+        return 0;
+    ++words;
+    spent[T_BUS] += param("word_ms") / 1000.0;
+    return 1;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *in = stdin;
+    unsigned int w, a, b;
+    double t, total, pages;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-v"))
+            verbose = 1;
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+            set_param(argv[++i]);
+        else if (argv[i][0] == '-') {
+            fprintf(stderr, "usage: wwtime [-v] [-s name=value]... [file]\n");
+            return 2;
+        }
+        else if (!(in = fopen(argv[i], "r"))) {
+            perror(argv[i]);
+            return 1;
+        }
+    }
+
+    while (next_word(in, &w)) {
+        if (w != 0x121)                                         // all commands start with 0x121
+            continue;
+        if (!next_word(in, &w))
+            break;
+        t = 0.0;
+        switch (w) {
+            case 0x003:                                         // print: code, microspaces to advance
+            case 0x004:                                         // erase: code, microspaces to advance
+                if (!next_word(in, &a) || !next_word(in, &b))
+                    goto done;
+                if (w == 0x003 && a) {                          // code 0 is a space, nothing struck
+                    t = strike(a, T_STRIKE, param("strike_ms"));
+                    ++strikes;
+                }
+                else if (w == 0x004) {
+                    t = strike(a, T_STRIKE, param("erase_ms"));
+                    ++erases;
+                }
+                if (w == 0x003)                                 // the carrier doesn't move on a correction strike (see ww_erase_strike())
+                    pendingCarrier += carrier_time(b);
+                if (verbose)
+                    printf("%s %02X +%u  %6.1f ms\n", w == 0x003 ? "print" : "erase", a, b, t * 1000.0);
+                break;
+            case 0x006:                                         // carrier move: direction/upper bits, lower bits
+                if (!next_word(in, &a) || !next_word(in, &b))
+                    goto done;
+                pendingCarrier += carrier_time(((a & 0x07) << 8) | b);
+                ++carrierMoves;
+                if (verbose)
+                    printf("move  %s%u\n", (a & 0x80) ? "+" : "-", ((a & 0x07) << 8) | b);
+                break;
+            case 0x005:                                         // paper move: direction, microlines
+                if (!next_word(in, &a))
+                    goto done;
+                settle_carrier();                               // platen and carrier don't overlap
+                t = (param("paper_start") + (a & 0x1F) * param("paper_ms")) / 1000.0;
+                spent[T_PAPER] += t;
+                ++paperMoves;
+                if (a & 0x80)
+                    paperUp += a & 0x1F;
+                if (verbose)
+                    printf("paper %s%u  %6.1f ms\n", (a & 0x80) ? "+" : "-", a & 0x1F, t * 1000.0);
+                break;
+            case 0x007:                                         // spin the printwheel
+                settle_carrier();
+                spent[T_SPIN] += param("spin_ms") / 1000.0;
+                wheelPos = 1;
+                ++spins;
+                if (verbose)
+                    printf("spin\n");
+                break;
+            default:                                            // queries and anything unknown: bus time only
+                break;
+        }
+    }
+done:
+    settle_carrier();
+
+    total = 0.0;
+    for (i = 0; i < T_CATEGORIES; i++)
+        total += spent[i];
+    pages = paperUp / (param("page_lines") * param("line_ulines"));
+
+    printf("words %lu, strikes %lu, erases %lu, carrier moves %lu, paper moves %lu, spins %lu\n",
+           words, strikes, erases, carrierMoves, paperMoves, spins);
+    for (i = 0; i < T_CATEGORIES; i++)
+        printf("%-8s %9.2f s  %5.1f%%\n", category[i], spent[i], total > 0.0 ? 100.0 * spent[i] / total : 0.0);
+    printf("total    %9.2f s\n", total);
+    if (pages > 0.0)
+        printf("pages    %9.2f  (%.1f s per page)\n", pages, total / pages);
+    return 0;
+}